@@ -0,0 +1,133 @@
+/* adaptive_model.hpp
+
+   Adaptive order-0 probability model for the arithmetic coder in arith_coder.hpp
+   (see static_model.hpp for the model interface).
+
+   Every symbol starts with a frequency of 1, and each coded symbol has its
+   frequency increased by INCREMENT. Rather than recomputing CF_low after every
+   update, the cumulative frequencies are stored in a Fenwick (binary indexed)
+   tree, so updates, cumulative frequency lookups and the decoder's symbol search
+   all take O(log n) time. Whenever the total exceeds MAX_TOTAL, all of the
+   frequencies are halved (which keeps the total well within the coder's
+   precision and lets the model adapt to changes in the input).
+*/
+
+#ifndef ADAPTIVE_MODEL_HPP
+#define ADAPTIVE_MODEL_HPP
+
+#include <array>
+#include <bit>
+#include <algorithm>
+#include <cstdint>
+#include "coder_stats.hpp"
+
+/* These definitions are more reliable for fixed width types than using "int" and assuming its width */
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+
+class AdaptiveModel{
+public:
+    static constexpr u32 EOF_SYMBOL = 256;
+    static constexpr u32 NUM_SYMBOLS = EOF_SYMBOL+1;
+
+    /* Amount added to a symbol's frequency each time it is coded */
+    static constexpr u32 INCREMENT = 32;
+
+    /* The frequencies are halved whenever the total exceeds this value */
+    static constexpr u32 MAX_TOTAL = 1<<16;
+
+    /* Constructor */
+    AdaptiveModel(){
+        frequencies.fill(1);
+        rebuild();
+    }
+
+    u64 total() const{
+        return global_cumulative_frequency;
+    }
+
+    void get_range(u32 symbol, u64& low, u64& high) const{
+        low = cumulative_frequency(symbol);
+        high = low + frequencies[symbol];
+    }
+
+    u32 find_symbol(u64 scaled_symbol, u64& low, u64& high) const{
+        //Walk down the tree to find the last symbol whose CF_low is at most scaled_symbol.
+        //At each step, pos is the number of symbols known to lie entirely below scaled_symbol
+        //(and remaining is scaled_symbol minus their total frequency).
+        u32 pos {0};
+        u64 remaining = scaled_symbol;
+        ARITH32_STAT_ADD(SearchCalls, 1);
+        ARITH32_STAT_ADD(SearchIterations, std::bit_width(TOP_STEP));
+        for (u32 step = TOP_STEP; step > 0; step >>= 1){
+            if (pos + step <= NUM_SYMBOLS && tree[pos + step] <= remaining){
+                pos += step;
+                remaining -= tree[pos];
+            }
+        }
+        low = scaled_symbol - remaining;
+        high = low + frequencies[pos];
+        return pos;
+    }
+
+    void get_byte_frequencies(std::array<u32, 256>& byte_frequencies) const{
+        std::copy_n(frequencies.begin(), 256, byte_frequencies.begin());
+    }
+
+    void remove_eof_symbol(){
+        //Halving never brings a frequency of zero back above zero
+        frequencies[EOF_SYMBOL] = 0;
+        rebuild();
+    }
+
+    void update(u32 symbol){
+        frequencies[symbol] += INCREMENT;
+        global_cumulative_frequency += INCREMENT;
+        if (global_cumulative_frequency > MAX_TOTAL){
+            //Halve every frequency (but don't let any of them reach zero)
+            for (auto& f: frequencies)
+                f = (f + 1)/2;
+            rebuild();
+            return;
+        }
+        for (u32 i = symbol+1; i <= NUM_SYMBOLS; i += i & -i)
+            tree[i] += INCREMENT;
+    }
+
+private:
+    /* The largest power of two which is at most NUM_SYMBOLS */
+    static constexpr u32 TOP_STEP = 256;
+
+    /* Total frequency of all symbols below the provided symbol (i.e. CF_low of the symbol) */
+    u64 cumulative_frequency(u32 symbol) const{
+        u64 result {0};
+        for (u32 i = symbol; i > 0; i -= i & -i)
+            result += tree[i];
+        return result;
+    }
+
+    /* Rebuild the tree (and total) from the frequencies in O(n) time */
+    void rebuild(){
+        //tree[i] holds the total frequency of symbols [i - (i & -i), i)
+        global_cumulative_frequency = 0;
+        for (u32 i = 1; i <= NUM_SYMBOLS; i++){
+            tree[i] = frequencies[i-1];
+            global_cumulative_frequency += frequencies[i-1];
+        }
+        for (u32 i = 1; i <= NUM_SYMBOLS; i++){
+            u32 parent = i + (i & -i);
+            if (parent <= NUM_SYMBOLS)
+                tree[parent] += tree[i];
+        }
+    }
+
+    std::array<u32, NUM_SYMBOLS> frequencies {};
+    std::array<u32, NUM_SYMBOLS+1> tree {}; //1-indexed
+    u64 global_cumulative_frequency {};
+};
+
+
+#endif
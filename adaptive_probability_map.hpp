@@ -0,0 +1,120 @@
+/* adaptive_probability_map.hpp
+
+   Logistic domain helpers and adaptive probability maps for the binary models
+   (see bit_tree_model.hpp).
+
+   stretch(p) = ln(p/(1-p)) and its inverse squash(x) = 1/(1 + e^-x) move a bit's
+   probability to and from the logistic domain, where an adaptive probability map
+   spreads its buckets evenly (see below).
+   Probabilities are 12 bit values (multiples of 2^-12) and the logistic domain is
+   scaled by 2^8 and limited to [-2047, 2047]. Both are computed with integer
+   arithmetic only (squash interpolates between the values of 1/(1 + e^-x) at
+   every half unit of x, and stretch is its inverse, found from a table), so the
+   encoder and decoder agree exactly on any machine.
+
+   An adaptive probability map (APM, also known as secondary symbol estimation, or
+   SSE) refines a probability given by a model using a small context: for each
+   context, it maps the stretched probability to a new probability by interpolating
+   between APM_BUCKETS adaptive values spread evenly over the logistic domain. Each
+   update moves the value of the nearer of the two buckets towards the bit coded.
+   A map starts as the identity, and learns how the model's predictions should be
+   corrected (e.g. where the model is systematically over- or under-confident, or
+   in which contexts it is).
+*/
+
+#ifndef ADAPTIVE_PROBABILITY_MAP_HPP
+#define ADAPTIVE_PROBABILITY_MAP_HPP
+
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+/* These definitions are more reliable for fixed width types than using "int" and assuming its width */
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+using i16 = std::int16_t;
+using i32 = std::int32_t;
+
+
+/* Returns 2^12/(1 + e^-(x/2^8)), clamped to [1, 4095] */
+inline i32 squash(i32 x){
+    //4096/(1 + e^-x) at x = -8, -7.5, ..., 8
+    static constexpr i32 points[33] {
+           1,    2,    3,    6,   10,   16,   27,   45,   73,  120,  194,  310,  488,  747, 1101, 1546,
+        2047, 2549, 2994, 3348, 3607, 3785, 3901, 3975, 4024, 4050, 4068, 4079, 4085, 4089, 4092, 4093,
+        4094};
+    if (x > 2047)
+        return 4095;
+    if (x < -2047)
+        return 1;
+    i32 weight = x & 127;
+    i32 index = (x>>7) + 16;
+    return std::max<i32>((points[index]*(128 - weight) + points[index + 1]*weight + 64)>>7, 1);
+}
+
+/* ln(p/(1 - p)) (scaled by 2^8) for each 12 bit probability p (the inverse of squash) */
+inline const auto STRETCH_TABLE = []{
+    std::array<i16, 4096> values {};
+    i32 next {0};
+    for (i32 x {-2047}; x <= 2047; x++){
+        i32 p = squash(x);
+        for (i32 i {next}; i <= p; i++)
+            values[i] = x;
+        next = p + 1;
+    }
+    for (i32 i {next}; i < 4096; i++)
+        values[i] = 2047;
+    return values;
+}();
+
+/* Returns ln(p/(1 - p)) (scaled by 2^8) for a 12 bit probability p (the inverse of squash) */
+inline i32 stretch(u32 p){
+    return STRETCH_TABLE[p];
+}
+
+
+/* Number of interpolation points of each context's map */
+inline constexpr u32 APM_BUCKETS = 33;
+
+class AdaptiveProbabilityMap{
+public:
+    /* Default rate of adaptation (each update moves a value 1/2^rate of the way towards the bit) */
+    static constexpr u32 DEFAULT_RATE = 7;
+
+    /* Constructor (with the number of contexts) */
+    explicit AdaptiveProbabilityMap( u32 num_contexts, u32 rate = DEFAULT_RATE ): values(num_contexts*APM_BUCKETS), rate {rate}, index {0} {
+        //Each context starts as the identity map (with 16 bit values)
+        for (u32 context {0}; context < num_contexts; context++)
+            for (u32 j {0}; j < APM_BUCKETS; j++)
+                values[context*APM_BUCKETS + j] = squash(((i32)j - 16)*128)*16;
+    }
+
+    /* Returns the refined probability (12 bits, in [1, 4095]) of the 12 bit probability p
+       in the given context. The next call to update must be for the bit with this probability. */
+    u32 refine(u32 p, u32 context){
+        i32 position = stretch(p) + 2048;
+        i32 weight = position & 127;
+        index = context*APM_BUCKETS + (position>>7);
+        u32 refined = (values[index]*(128 - weight) + values[index + 1]*weight)>>11;
+        //Update the nearer bucket
+        index += weight>>6;
+        return std::clamp<u32>(refined, 1, 4095);
+    }
+
+    /* Update the map with the bit whose probability was last refined */
+    void update(u32 bit){
+        u32 target = bit? 0xffff : 0;
+        values[index] += ((i32)target - (i32)values[index])>>rate;
+    }
+
+private:
+    std::vector<u16> values;
+    u32 rate;
+    u32 index;   //The bucket to update
+};
+
+
+#endif
@@ -0,0 +1,215 @@
+/* apm_model.hpp
+
+   Secondary estimation stage for the binary models (see bit_tree_model.hpp):
+   ApmModel<Model> wraps any binary model, and refines each of its predictions
+   with an adaptive probability map (see adaptive_probability_map.hpp) whose
+   context is the bits of the current byte seen so far (order 0), before the
+   prediction is used by the coder. The final probability is a weighted average
+   of the model's own prediction and the refined one (which is more robust than
+   the refined probability alone while the map is still learning).
+
+   The map learns how the model's predictions should be corrected, e.g. where a
+   model with fixed rate updates (like BitTreeModel) is too cautious about the
+   probabilities it sees most often, for a small cost per bit (one table lookup
+   and interpolation, and one update). ApmModel is itself a binary model, so it
+   can be used anywhere the wrapped model can, and it passes the wrapped model's
+   header (if any) through unchanged.
+
+   An APM refines the probability of a binary decision, so the multi-symbol
+   adaptive models (AdaptiveModel, Order1Model and HashedContextModel) are first
+   turned into binary models by BinarizedModel<Model>, which codes each byte as
+   8 binary decisions (most significant bit first) with the probabilities implied
+   by the model's byte frequencies: the probability that the next bit is a 1 is
+   the total frequency of the bytes which start with the bits seen so far and a 1,
+   divided by the total frequency of the bytes which start with the bits seen so
+   far. The model itself is updated once per byte, exactly as when it is used
+   with a multi-symbol coder, so it codes the same distribution (apart from the
+   EOF symbol, which the binary coder codes separately, and the code space which
+   HashedContextModel leaves unused).
+*/
+
+#ifndef APM_MODEL_HPP
+#define APM_MODEL_HPP
+
+#include <array>
+#include <utility>
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include "bit_tree_model.hpp"
+#include "adaptive_probability_map.hpp"
+
+/* These definitions are more reliable for fixed width types than using "int" and assuming its width */
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+
+/* Models with a frequency for each byte value (see get_byte_frequencies in static_model.hpp) */
+template<typename Model>
+concept ByteFrequencyModel = requires (const Model& model, std::array<u32, 256>& frequencies){
+    model.get_byte_frequencies(frequencies);
+    { Model::EOF_SYMBOL } -> std::convertible_to<u32>;
+};
+
+
+template<ByteFrequencyModel Model>
+class BinarizedModel{
+public:
+    static constexpr u32 EOF_SYMBOL = Model::EOF_SYMBOL;
+
+    static constexpr u32 PROBABILITY_BITS = 12;
+
+    /* Constructor (any arguments are passed to the wrapped model's constructor) */
+    template<typename... Args>
+    explicit BinarizedModel( Args&&... args ): model {std::forward<Args>(args)...}, eof {true} {
+        start_byte();
+    }
+
+    u32 probability() const{
+        return p;
+    }
+
+    void update_bit(u32 bit){
+        node = 2*node + bit;
+        if (node >= 256){
+            //The byte is complete
+            model.update(node - 256);
+            start_byte();
+        }else{
+            predict();
+        }
+    }
+
+    bool has_eof_symbol() const{
+        return eof;
+    }
+
+    void remove_eof_symbol(){
+        model.remove_eof_symbol();
+        eof = false;
+    }
+
+    template<typename OutStream>
+    requires requires (const Model& m, OutStream& stream){ m.write_header(stream); }
+    void write_header(OutStream& stream) const{
+        model.write_header(stream);
+    }
+
+    template<typename InStream>
+    requires requires (Model& m, InStream& stream){ m.read_header(stream); }
+    void read_header(InStream& stream){
+        model.read_header(stream);
+        start_byte();
+    }
+
+private:
+    /* Take the model's byte frequencies for the next byte */
+    void start_byte(){
+        model.get_byte_frequencies(frequencies);
+        //Sum each level of the tree from the level below it (one level at a time, so that
+        //each loop has a fixed length and no dependencies between its iterations)
+        for (u32 i {0}; i < 128; i++)
+            sums[128 + i] = frequencies[2*i] + frequencies[2*i + 1];
+        for (u32 level {64}; level > 0; level /= 2)
+            for (u32 i {0}; i < level; i++)
+                sums[level + i] = sums[2*(level + i)] + sums[2*(level + i) + 1];
+        node = 1;
+        predict();
+    }
+
+    /* Total frequency of the bytes below the given node of the tree */
+    u32 node_total(u32 n) const{
+        return n < 256? sums[n] : frequencies[n - 256];
+    }
+
+    /* Compute the probability that the next bit is a 1 (keeping it strictly between 0 and 1) */
+    void predict(){
+        u32 total = node_total(node);
+        u32 ones = node_total(2*node + 1);
+        if (total == 0)
+            p = 1<<(PROBABILITY_BITS - 1);
+        else
+            p = std::clamp<u32>((ones<<PROBABILITY_BITS)/total, 1, (1<<PROBABILITY_BITS) - 1);
+    }
+
+    Model model;
+    //The tree has a node for each prefix of a byte: node 1 is the empty prefix, the children
+    //of node n are 2n (for a 0 bit) and 2n + 1 (for a 1 bit), and the leaves 256 to 511 are
+    //the byte values. sums holds the total frequency below each internal node.
+    std::array<u32, 256> frequencies;   //Of the current byte (the leaves)
+    std::array<u32, 256> sums;
+    u32 node;   //Of the bits of the current byte seen so far
+    u32 p;
+    bool eof;
+};
+
+
+template<BinaryModel Model>
+class ApmModel{
+public:
+    static constexpr u32 EOF_SYMBOL = Model::EOF_SYMBOL;
+
+    static constexpr u32 PROBABILITY_BITS = 12;
+
+    /* Constructor (any arguments are passed to the wrapped model's constructor) */
+    template<typename... Args>
+    explicit ApmModel( Args&&... args ): model {std::forward<Args>(args)...}, map {256} {
+        refine();
+    }
+
+    u32 probability() const{
+        return p;
+    }
+
+    void update_bit(u32 bit){
+        map.update(bit);
+        model.update_bit(bit);
+        c0 = 2*c0 + bit;
+        if (c0 >= 256)
+            c0 = 1;
+        refine();
+    }
+
+    bool has_eof_symbol() const{
+        return model.has_eof_symbol();
+    }
+
+    void remove_eof_symbol(){
+        model.remove_eof_symbol();
+    }
+
+    template<typename OutStream>
+    requires requires (const Model& m, OutStream& stream){ m.write_header(stream); }
+    void write_header(OutStream& stream) const{
+        model.write_header(stream);
+    }
+
+    template<typename InStream>
+    requires requires (Model& m, InStream& stream){ m.read_header(stream); }
+    void read_header(InStream& stream){
+        model.read_header(stream);
+        refine();
+    }
+
+private:
+    /* Refine the wrapped model's prediction of the next bit */
+    void refine(){
+        u32 q = model.probability();
+        //Bring the model's probability to 12 bits (keeping it strictly between 0 and 1)
+        if constexpr (Model::PROBABILITY_BITS > PROBABILITY_BITS)
+            q = std::clamp<u32>(q>>(Model::PROBABILITY_BITS - PROBABILITY_BITS), 1, 4095);
+        else if constexpr (Model::PROBABILITY_BITS < PROBABILITY_BITS)
+            q <<= PROBABILITY_BITS - Model::PROBABILITY_BITS;
+        p = (q + 3*map.refine(q, c0) + 2)>>2;
+    }
+
+    Model model;
+    AdaptiveProbabilityMap map;   //With the partial byte as its context
+    u32 c0 {1};   //The bits of the current byte seen so far, after a leading 1
+    u32 p {2048};
+};
+
+
+#endif
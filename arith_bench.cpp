@@ -0,0 +1,343 @@
+/* arith_bench.cpp
+
+   Throughput benchmark for every combination of model and coder (see codec.hpp),
+   run on a set of generated corpora (so that results are comparable between
+   machines and commits without any external data):
+     uniform     Uniformly random bytes
+     zipf        Bytes drawn from a Zipf distribution (s = 1.1) over all 256 values
+     text        English-like text (a Zipf-distributed vocabulary of words built from
+                 English letter frequencies, with punctuation and line breaks)
+     runs        Runs of repeated bytes (geometric run lengths, mean 16) from a
+                 small alphabet
+     telemetry   Binary sensor records (timestamps, sensor IDs, slowly varying
+                 readings, counters and mostly-zero status flags)
+
+   Each encode and decode is repeated several times (the median time is reported)
+   and every decoded result is checked against the original, so the benchmark also
+   fails (with a nonzero exit status) if any combination stops round tripping.
+
+   The results are written to std::cout as CSV (the default) or JSON, with one
+   row per corpus/model/coder: the encode and decode throughput (MB/s, with
+   1 MB = 10^6 bytes), the time per symbol (ns), and the compressed size in bits
+   per symbol along with the order-0 (Shannon) entropy of the corpus.
+
+   Usage: arith_bench [-s size] [-n repetitions] [-f csv|json] [-k corpus] [-m model] [-c coder]
+*/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <array>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include "codec.hpp"
+#include "histogram.hpp"
+#include "cli_options.hpp"
+
+
+/* Draw from a Zipf distribution over [0, n) with exponent s */
+class ZipfDistribution{
+public:
+    ZipfDistribution( u32 n, double s ){
+        std::vector<double> weights(n);
+        for (u32 k {0}; k < n; k++)
+            weights.at(k) = 1.0/std::pow(k + 1, s);
+        distribution = std::discrete_distribution<u32>(weights.begin(), weights.end());
+    }
+    template<typename Generator>
+    u32 operator()(Generator& generator){
+        return distribution(generator);
+    }
+private:
+    std::discrete_distribution<u32> distribution;
+};
+
+
+std::vector<u8> generate_uniform(std::size_t length, std::mt19937_64& generator){
+    std::vector<u8> data(length);
+    for (auto& b: data)
+        b = generator();
+    return data;
+}
+
+std::vector<u8> generate_zipf(std::size_t length, std::mt19937_64& generator){
+    ZipfDistribution zipf {256, 1.1};
+    std::vector<u8> data(length);
+    for (auto& b: data)
+        b = zipf(generator);
+    return data;
+}
+
+std::vector<u8> generate_text(std::size_t length, std::mt19937_64& generator){
+    //English letter frequencies (per 1000 letters, a - z)
+    const std::array<double, 26> letter_weights {82, 15, 28, 43, 127, 22, 20, 61, 70, 2, 8, 40, 24, 67, 75, 19, 1, 60, 63, 91, 28, 10, 24, 2, 20, 1};
+    std::discrete_distribution<u32> letters(letter_weights.begin(), letter_weights.end());
+    std::discrete_distribution<u32> word_lengths {0, 3, 17, 21, 16, 11, 9, 8, 6, 4, 3, 2};
+    std::vector<std::string> vocabulary(4096);
+    for (auto& word: vocabulary){
+        u32 word_length = word_lengths(generator);
+        for (u32 i {0}; i < word_length; i++)
+            word.push_back('a' + letters(generator));
+    }
+    ZipfDistribution words {(u32)vocabulary.size(), 1.0};
+    std::uniform_int_distribution<u32> percent {0, 99};
+
+    std::string text {};
+    std::size_t line_length {0};
+    bool capitalize = true;
+    while(text.size() < length){
+        std::string word = vocabulary.at(words(generator));
+        if (capitalize)
+            word.at(0) = word.at(0) - 'a' + 'A';
+        capitalize = false;
+        text += word;
+        line_length += word.size();
+        u32 p = percent(generator);
+        if (p < 6){
+            text += '.';
+            capitalize = true;
+        }else if (p < 12){
+            text += ',';
+        }
+        if (line_length > 70){
+            text += '\n';
+            line_length = 0;
+        }else{
+            text += ' ';
+            line_length++;
+        }
+    }
+    return std::vector<u8>(text.begin(), text.begin() + length);
+}
+
+std::vector<u8> generate_runs(std::size_t length, std::mt19937_64& generator){
+    std::geometric_distribution<u32> run_lengths {1.0/16};
+    std::uniform_int_distribution<u32> values {0, 15};
+    std::vector<u8> data {};
+    while(data.size() < length){
+        u8 value = 'A' + values(generator);
+        data.insert(data.end(), std::min<std::size_t>(run_lengths(generator) + 1, length - data.size()), value);
+    }
+    return data;
+}
+
+std::vector<u8> generate_telemetry(std::size_t length, std::mt19937_64& generator){
+    //Each record is 16 bytes (little endian): a 32 bit timestamp (ms), a 16 bit sensor ID,
+    //a 16 bit reading (a random walk per sensor), a 32 bit event counter and a 32 bit status word
+    const u32 NUM_SENSORS = 12;
+    std::array<int32_t, NUM_SENSORS> readings {};
+    std::array<u32, NUM_SENSORS> counters {};
+    std::normal_distribution<double> jitter {0, 3};
+    std::normal_distribution<double> step {0, 4};
+    std::uniform_int_distribution<u32> percent {0, 99};
+    u32 timestamp {1700000000};
+    std::vector<u8> data {};
+    auto push_le = [&](u64 value, u32 num_bytes){
+        for (u32 i {0}; i < num_bytes; i++)
+            data.push_back((u8)(value>>(8*i)));
+    };
+    while(data.size() < length){
+        for (u32 sensor {0}; sensor < NUM_SENSORS; sensor++){
+            readings.at(sensor) = std::clamp<int32_t>(readings.at(sensor) + std::lround(step(generator)), -30000, 30000);
+            counters.at(sensor) += percent(generator) < 30;
+            push_le(timestamp, 4);
+            push_le(100 + sensor, 2);
+            push_le((u16)(int16_t)(2000 + readings.at(sensor)), 2);
+            push_le(counters.at(sensor), 4);
+            push_le(percent(generator) < 2 ? 1U<<percent(generator)%8 : 0, 4);
+        }
+        timestamp += 1000 + std::lround(jitter(generator));
+    }
+    data.resize(length);
+    return data;
+}
+
+
+struct Corpus{
+    const char* name;
+    std::vector<u8> (*generate)(std::size_t, std::mt19937_64&);
+};
+
+const Corpus CORPORA[] {
+    {"uniform", generate_uniform},
+    {"zipf", generate_zipf},
+    {"text", generate_text},
+    {"runs", generate_runs},
+    {"telemetry", generate_telemetry},
+};
+
+
+/* Order-0 entropy of the data, in bits per symbol */
+double shannon_entropy(const std::vector<u8>& data){
+    return histogram_entropy(byte_histogram(data.data(), data.size()));
+}
+
+/* Returns the median of the provided times */
+double median(std::vector<double> values){
+    std::sort(values.begin(), values.end());
+    std::size_t n = values.size();
+    return n%2? values.at(n/2) : (values.at(n/2 - 1) + values.at(n/2))/2;
+}
+
+
+struct BenchOptions{
+    u64 size {1<<20};
+    u32 repetitions {5};
+    bool json {false};
+    std::string corpus {};   //Only run the corpus, model or coder with this name (if nonempty)
+    std::string model {};
+    std::string coder {};
+};
+
+struct BenchResult{
+    std::string corpus;
+    std::string model;
+    std::string coder;
+    u64 size;
+    u64 encoded_size;
+    double entropy;         //Bits per symbol
+    double encode_seconds;  //Median over the repetitions
+    double decode_seconds;
+};
+
+
+void print_bench_usage(const char* program_name){
+    std::cerr << "Usage: " << program_name << " [-s size] [-n repetitions] [-f csv|json] [-k corpus] [-m model] [-c coder]" << std::endl;
+    std::cerr << "  -s size          Size of each corpus (in bytes, or with a K or M suffix; default: 1M)" << std::endl;
+    std::cerr << "  -n repetitions   Number of times to encode and decode each corpus (default: 5)" << std::endl;
+    std::cerr << "  -f format        Output format: csv (the default) or json" << std::endl;
+    std::cerr << "  -k corpus        Only run the given corpus. One of:";
+    for (const auto& corpus: CORPORA)
+        std::cerr << " " << corpus.name;
+    std::cerr << std::endl;
+    std::cerr << "  -m model         Only run the given model" << std::endl;
+    std::cerr << "  -c coder         Only run the given coder" << std::endl;
+}
+
+bool parse_bench_options(int argc, char** argv, BenchOptions& options){
+    for (int i = 1; i < argc; i++){
+        std::string arg {argv[i]};
+        if (i+1 >= argc){
+            print_bench_usage(argv[0]);
+            return false;
+        }
+        std::string value {argv[++i]};
+        if (arg == "-s" && parse_size(value) != 0){
+            options.size = parse_size(value);
+        }else if (arg == "-n" && parse_size(value) != 0){
+            options.repetitions = parse_size(value);
+        }else if (arg == "-f" && (value == "csv" || value == "json")){
+            options.json = value == "json";
+        }else if (arg == "-k"){
+            options.corpus = value;
+        }else if (arg == "-m"){
+            options.model = value;
+        }else if (arg == "-c"){
+            options.coder = value;
+        }else{
+            print_bench_usage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/* Encode and decode the data repeatedly with the given model and coder.
+   Returns false if any decode does not reproduce the data. */
+bool run_benchmark(const std::vector<u8>& data, ModelType model, CoderType coder, u32 repetitions, BenchResult& result){
+    using Clock = std::chrono::steady_clock;
+    std::vector<double> encode_times {}, decode_times {};
+    std::vector<u8> encoded {};
+    std::vector<u8> decoded(data.size());
+    for (u32 i {0}; i < repetitions; i++){
+        encoded.clear();
+        auto start = Clock::now();
+        encode_buffer(model, coder, data.data(), data.size(), encoded);
+        auto encoded_time = Clock::now();
+        bool valid = decode_buffer(model, coder, encoded.data(), encoded.size(), decoded.data(), decoded.size());
+        auto decoded_time = Clock::now();
+        if (!valid || decoded != data)
+            return false;
+        encode_times.push_back(std::chrono::duration<double>(encoded_time - start).count());
+        decode_times.push_back(std::chrono::duration<double>(decoded_time - encoded_time).count());
+    }
+    result.encoded_size = encoded.size();
+    result.encode_seconds = median(encode_times);
+    result.decode_seconds = median(decode_times);
+    return true;
+}
+
+
+void print_csv_header(){
+    std::cout << "corpus,model,coder,size,encoded_size,bits_per_symbol,entropy_bits_per_symbol,"
+              << "encode_mb_per_s,decode_mb_per_s,encode_ns_per_symbol,decode_ns_per_symbol" << std::endl;
+}
+
+void print_result(const BenchResult& result, bool json, bool first){
+    double symbols = std::max<u64>(result.size, 1);
+    double bits_per_symbol = 8.0*result.encoded_size/symbols;
+    double encode_mb_per_s = result.size/result.encode_seconds/1e6;
+    double decode_mb_per_s = result.size/result.decode_seconds/1e6;
+    double encode_ns = result.encode_seconds*1e9/symbols;
+    double decode_ns = result.decode_seconds*1e9/symbols;
+    if (json){
+        std::cout << (first? "  " : ",\n  ")
+                  << "{\"corpus\": \"" << result.corpus << "\", \"model\": \"" << result.model << "\", \"coder\": \"" << result.coder << "\""
+                  << ", \"size\": " << result.size << ", \"encoded_size\": " << result.encoded_size
+                  << ", \"bits_per_symbol\": " << bits_per_symbol << ", \"entropy_bits_per_symbol\": " << result.entropy
+                  << ", \"encode_mb_per_s\": " << encode_mb_per_s << ", \"decode_mb_per_s\": " << decode_mb_per_s
+                  << ", \"encode_ns_per_symbol\": " << encode_ns << ", \"decode_ns_per_symbol\": " << decode_ns << "}";
+    }else{
+        std::cout << result.corpus << "," << result.model << "," << result.coder << "," << result.size << "," << result.encoded_size << ","
+                  << bits_per_symbol << "," << result.entropy << "," << encode_mb_per_s << "," << decode_mb_per_s << ","
+                  << encode_ns << "," << decode_ns << std::endl;
+    }
+}
+
+
+int main(int argc, char** argv){
+    BenchOptions options {};
+    if (!parse_bench_options(argc, argv, options))
+        return 1;
+
+    if (options.json)
+        std::cout << "[\n";
+    else
+        print_csv_header();
+    bool first = true;
+    bool failed = false;
+    for (const auto& corpus: CORPORA){
+        if (!options.corpus.empty() && options.corpus != corpus.name)
+            continue;
+        //Each corpus has its own fixed seed (a hash of its name), so it is identical in every
+        //run (with the same standard library, which implements the random distributions)
+        u64 seed {0xcbf29ce484222325};
+        for (const char* c = corpus.name; *c; c++)
+            seed = (seed ^ (u8)*c)*0x100000001b3;
+        std::mt19937_64 generator {seed};
+        std::vector<u8> data = corpus.generate(options.size, generator);
+        double entropy = shannon_entropy(data);
+        for (const auto& model: MODEL_NAMES){
+            if (!options.model.empty() && options.model != model.name)
+                continue;
+            for (const auto& coder: CODER_NAMES){
+                if ((!options.coder.empty() && options.coder != coder.name) || !coder_supports_model(coder.type, model.type))
+                    continue;
+                BenchResult result {corpus.name, model.name, coder.name, data.size(), 0, entropy, 0, 0};
+                if (!run_benchmark(data, model.type, coder.type, options.repetitions, result)){
+                    std::cerr << "Round trip failed: " << corpus.name << " " << model.name << " " << coder.name << std::endl;
+                    failed = true;
+                    continue;
+                }
+                print_result(result, options.json, first);
+                first = false;
+            }
+        }
+    }
+    if (options.json)
+        std::cout << "\n]" << std::endl;
+    return failed? 1 : 0;
+}
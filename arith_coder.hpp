@@ -0,0 +1,367 @@
+/* arith_coder.hpp
+
+   Arithmetic encoder and decoder with 32-bit internal precision.
+
+   Both classes are templates over the probability model (see static_model.hpp
+   for the interface a model must provide) and the bit stream type (any of
+   the classes in output_stream.hpp / input_stream.hpp), so they can be used
+   with std::ostream/std::istream based streams or directly on memory buffers
+   (see arith_encode_buffer and arith_decode_buffer at the bottom of this file).
+
+   The model is held by reference and is updated (via Model::update) after
+   every symbol, so the encoder and decoder must each be given their own
+   identically constructed model.
+*/
+
+#ifndef ARITH_CODER_HPP
+#define ARITH_CODER_HPP
+
+#include <vector>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include "input_stream.hpp"
+#include "output_stream.hpp"
+#include "static_model.hpp"
+#include "coder_stats.hpp"
+
+
+/* Scale a cumulative frequency (in [0, model.total()]) to the current range,
+   i.e. compute (current_range*cumulative_frequency)/model.total().
+   If the model's total is a power of two, the division becomes a shift, which 
+   produces an identical result. */
+template<typename Model>
+inline u64 scale_to_range(const Model& model, u64 current_range, u64 cumulative_frequency){
+    if constexpr (PowerOfTwoModel<Model>)
+        return (current_range*cumulative_frequency)>>Model::TOTAL_BITS;
+    else
+        return (current_range*cumulative_frequency)/model.total();
+}
+
+
+/* Reverse the order of the bits of v (so that bits can be moved between the MSB-first
+   bounds and the LSB-first bit streams in one step) */
+inline u32 reverse_bits(u32 v){
+    v = __builtin_bswap32(v);
+    v = ((v>>4) & 0x0f0f0f0f) | ((v & 0x0f0f0f0f)<<4);
+    v = ((v>>2) & 0x33333333) | ((v & 0x33333333)<<2);
+    v = ((v>>1) & 0x55555555) | ((v & 0x55555555)<<1);
+    return v;
+}
+
+
+template<typename Model, typename OutStream>
+class ArithEncoder{
+public:
+    /* The largest number of pending underflow bits which encode_symbol pushes
+       without branching (more than this are pushed separately) */
+    static constexpr u64 MAX_PENDING_UNDERFLOW = 31;
+
+    /* The bounds and the pending underflow bits, which are kept apart from the model and
+       stream so that a loop can hold them in local variables (see encode and
+       InterleavedArithEncoder::encode) */
+    struct State{
+        u32 lower_bound {0};
+        u32 upper_bound {~0U};
+        u64 underflow_counter {0};
+    };
+
+    /* Constructor */
+    ArithEncoder( Model& model, OutStream& stream ): model {model}, stream {stream}, state {} {
+
+    }
+
+    /* Encode every byte of the provided buffer */
+    void encode(const u8* data, std::size_t length){
+        State local_state = state;
+        for(std::size_t i {0}; i < length; i++)
+            encode_symbol(model, stream, local_state, data[i]);
+        state = local_state;
+    }
+
+    /* Encode a single symbol */
+    void encode_symbol(u32 symbol){
+        encode_symbol(model, stream, state, symbol);
+    }
+
+    /* Returns the coder state (see State) */
+    State& get_state(){
+        return state;
+    }
+
+    /* Encode a single symbol with the provided model, stream and coder state */
+    static void encode_symbol(Model& model, OutStream& stream, State& state, u32 symbol){
+        ARITH32_STAT_CYCLES(EncodeCycles);
+        ARITH32_STAT_ADD(SymbolsEncoded, 1);
+        auto [lower_bound, upper_bound, underflow_counter] = state;
+        //For safety, we will use u64 for all of our intermediate calculations.
+        u64 current_range = ((u64)upper_bound + 1) - (u64)lower_bound;
+        u64 symbol_range_low, symbol_range_high;
+        model.get_range(symbol, symbol_range_low, symbol_range_high);
+        upper_bound = lower_bound + scale_to_range(model, current_range, symbol_range_high) - 1;
+        lower_bound = lower_bound + scale_to_range(model, current_range, symbol_range_low);
+
+        {
+            ARITH32_STAT_CYCLES(ModelCycles);
+            model.update(symbol);
+        }
+
+        //Now determine if lower_bound and upper_bound share any of their most significant bits and push
+        //them to the output stream if so. (Shifting these out one at a time, as long as the MSBs match,
+        //is the same as shifting out all of the leading bits the bounds have in common at once.)
+        u32 shared_bits = std::countl_zero(lower_bound ^ upper_bound);
+        if (shared_bits > 0 && underflow_counter > MAX_PENDING_UNDERFLOW) [[unlikely]]{
+            //Push the most significant bit of upper/lower
+            u32 b = (upper_bound>>31);
+            stream.push_bit(b);
+            //Now push underflow_counter copies of the opposite bit
+            stream.push_repeated(!b, underflow_counter);
+            underflow_counter = 0;
+            //Then the rest of the shared bits (MSB first)
+            stream.push_bits(reverse_bits(lower_bound<<1), shared_bits - 1);
+        }else{
+            //Otherwise the same bits (the MSB, the pending underflow bits if there are
+            //any shared bits, then the rest of the shared bits) are assembled into one
+            //word and pushed without branching, since whether there are pending underflow
+            //bits is too unpredictable to branch on. This also does nothing if there are
+            //no shared bits.
+            u32 pending = (shared_bits > 0)? (u32)underflow_counter : 0;
+            u64 b = lower_bound>>31;
+            u64 bits = b | ((((u64)1<<pending) - 1) & (b - 1))<<1 | (u64)reverse_bits(lower_bound<<1)<<(pending + 1);
+            u32 num_bits = shared_bits + pending;
+            if (num_bits > 32) [[unlikely]]{
+                stream.push_bits((u32)bits, 32);
+                stream.push_bits((u32)(bits>>32), num_bits - 32);
+            }else{
+                stream.push_bits((u32)bits, num_bits);
+            }
+            underflow_counter -= pending;
+        }
+
+        //Shift the shared bits out of upper_bound (shifting in 1s from the right) and
+        //lower_bound (shifting in 0s)
+        upper_bound = (u32)(((u64)upper_bound<<shared_bits) | (((u64)1<<shared_bits) - 1));
+        lower_bound = (u32)((u64)lower_bound<<shared_bits);
+
+        //Now the MSB of upper_bound must be 1 and the MSB of lower_bound must be 0.
+        //If we discover that lower_bound = 01... and upper_bound = 10..., then we have
+        //to account for underflow, by splicing out the second-most-significant bit of
+        //both (and counting it in underflow_counter). Since the MSBs still differ afterward,
+        //this repeats for as long as the next bits of lower_bound are 1 and the next bits
+        //of upper_bound are 0, so the number of splices can also be found in one step.
+        //(None of this changes anything if there are no underflow bits, so it is done unconditionally.)
+        u32 underflow_bits = std::countl_one((lower_bound & ~upper_bound)<<1);
+        underflow_counter += underflow_bits;
+        ARITH32_STAT_ADD(RenormalizationShifts, shared_bits + underflow_bits);
+        ARITH32_STAT_ADD(UnderflowEvents, underflow_bits);
+        ARITH32_STAT_MAX(MaxUnderflowRun, underflow_counter);
+
+        //If upper_bound = 10(xyz...), set upper_bound = 1(xyz...) (shifting in 1s)
+        upper_bound = (upper_bound<<underflow_bits) | (1U<<31) | ((1U<<underflow_bits) - 1);
+
+        //If lower_bound = 01(abc...), set lower_bound = 0(abc...) (shifting in 0s)
+        lower_bound = (lower_bound<<underflow_bits) & ((1U<<31) - 1);
+        state = {lower_bound, upper_bound, underflow_counter};
+    }
+
+    /* Encode the EOF symbol and flush the final bits of the encoding to the stream
+       (no further symbols may be encoded afterward) */
+    void finish(){
+        encode_symbol(Model::EOF_SYMBOL);
+
+        //When encoding is finished, we need to dump out just enough of the remaining
+        //bits that the decompressor can keep up with us.
+        //At this point,
+        //   upper = 1...
+        //   lower = 0...
+        // (since if the MSBs matched they would have been shifted out during the loop above)
+        //Therefore, the string 0111... (with an infinite string of 1's) will be in the range
+        //[lower,upper).
+        //We can rig the decompressor to duplicate the last bit in the stream infinitely
+        //when the end of the stream is reached, so all we have to do is emit the
+        //sequence 01... followed by enough extra one bits to pad out the last byte of
+        //the stream.
+
+        //Note that this trick doesn't work if you have other data past the end of
+        //the encoded stream in the file (since the decompressor uses the EOF signal
+        //to achieve this trick). Instead, if you want to have something in the file
+        //after the encoded stream, you will likely have to follow the bits 01 with
+        //a few bytes of all ones (i.e. 0xff), or indicate to the decompressor in advance
+        //that the stream is going to end (e.g. with a block size value).
+        stream.push_bit(0);
+        stream.push_bit(1);
+        stream.flush_to_byte(1); //Emit enough 1s to fill out the byte
+    }
+
+    /* Flush the final bits of the encoding to the stream without encoding the EOF symbol,
+       for streams whose length is stored separately (no further symbols may be encoded afterward) */
+    void finish_without_eof(){
+        //As in finish(), the string 0111... lies in [lower,upper). Rather than relying on the
+        //decompressor to duplicate the last bit of the stream, enough 1s are written to cover
+        //all of the bits it reads while decoding the last symbol: the pending underflow bits
+        //and the rest of its 32 bit window.
+        stream.push_bit(0);
+        stream.push_repeated(1, state.underflow_counter + 31);
+        stream.flush_to_byte(1);
+    }
+
+private:
+    Model& model;
+    OutStream& stream;
+    State state;
+};
+
+
+
+template<typename Model, typename InStream>
+class ArithDecoder{
+public:
+    /* Constructor (reads the first 32 bits of the encoded stream) */
+    ArithDecoder( Model& model, InStream& stream ): model {model}, stream {stream}, lower_bound {0}, upper_bound {~0U}, encoded_bits {0}, done {false} {
+        for(int i = 0; i < 32; i++){
+            encoded_bits = (encoded_bits<<1) | stream.read_bit();
+        }
+    }
+
+    /* Decode symbols into the provided buffer until either the buffer is full or
+       the EOF symbol is reached. Returns the number of bytes written. */
+    std::size_t decode(u8* output, std::size_t capacity){
+        std::size_t length {0};
+        while(length < capacity && !done){
+            u32 symbol = decode_symbol();
+            if (symbol == Model::EOF_SYMBOL)
+                break;
+            output[length++] = symbol;
+        }
+        return length;
+    }
+
+    /* Returns true once the EOF symbol has been decoded */
+    bool finished() const{
+        return done;
+    }
+
+    /* Decode a single symbol */
+    u32 decode_symbol(){
+        ARITH32_STAT_CYCLES(DecodeCycles);
+        ARITH32_STAT_ADD(SymbolsDecoded, 1);
+        //For safety, we will use u64 for all of our intermediate calculations.
+        u64 current_range = (u64)upper_bound - (u64)lower_bound + 1;
+
+        //Figure out which symbol comes next
+
+        //First scale the encoded bitstring (which lies between lower_bound and upper_bound)
+        //to the range [0, global_cumulative_frequency)
+        //With pure real arithmetic, this is equivalent to the equation
+        //  scaled = (encoded-low)*(global_cumulative_frequency/current_range),
+        //however, we have to salt it with +1 and -1 terms (and rearrange it) to accommodate
+        //fixed-point arithmetic.
+        //(With a power-of-two total, the multiplication is a shift, but the division 
+        //by current_range remains.)
+        u64 scaled_symbol;
+        if constexpr (PowerOfTwoModel<Model>)
+            scaled_symbol = ((((u64)encoded_bits - lower_bound + 1)<<Model::TOTAL_BITS) - 1)/current_range;
+        else
+            scaled_symbol = (((u64)encoded_bits - lower_bound + 1)*model.total() - 1)/current_range;
+
+        u64 symbol_range_low, symbol_range_high;
+        u32 symbol;
+        {
+            ARITH32_STAT_CYCLES(SearchCycles);
+            symbol = model.find_symbol(scaled_symbol, symbol_range_low, symbol_range_high);
+        }
+
+        //If the symbol is the EOF marker, we're done
+        if (symbol == Model::EOF_SYMBOL){
+            done = true;
+            return symbol;
+        }
+
+        //Now that we know what symbol comes next, we repeat the same process as the compressor
+        //to prepare for the next iteration.
+
+        upper_bound = lower_bound + scale_to_range(model, current_range, symbol_range_high) - 1;
+        lower_bound = lower_bound + scale_to_range(model, current_range, symbol_range_low);
+
+        {
+            ARITH32_STAT_CYCLES(ModelCycles);
+            model.update(symbol);
+        }
+
+        //Even though we don't have to output bits, we do have to
+        //adjust the lower and upper bounds just like the compressor does
+        //(see ArithEncoder::encode_symbol, including why both steps below
+        // do nothing if there are no bits to shift out).
+
+        //Shift the shared leading bits out of upper_bound, lower_bound and the encoded string
+        //(Note that if lower and upper bounds share their leading bits, so does the 
+        // encoded bitstring), bringing new encoded bits in on the right.
+        u32 shared_bits = std::countl_zero(lower_bound ^ upper_bound);
+        upper_bound = (u32)(((u64)upper_bound<<shared_bits) | (((u64)1<<shared_bits) - 1));
+        lower_bound = (u32)((u64)lower_bound<<shared_bits);
+        encoded_bits = (u32)(((u64)encoded_bits<<shared_bits) | read_bits_msb_first(shared_bits));
+
+        //Then splice out any underflow bits
+        u32 underflow_bits = std::countl_one((lower_bound & ~upper_bound)<<1);
+        upper_bound = (upper_bound<<underflow_bits) | (1U<<31) | ((1U<<underflow_bits) - 1);
+        lower_bound = (lower_bound<<underflow_bits) & ((1U<<31) - 1);
+        ARITH32_STAT_ADD(RenormalizationShifts, shared_bits + underflow_bits);
+        ARITH32_STAT_ADD(UnderflowEvents, underflow_bits);
+
+        //Since upper = 10... and lower = 01..., we know that
+        //either encoded_bits = 10... or encoded_bits = 01...
+        //(since encoded_bits must be between lower and upper)
+        //We want to splice out the second-most-significant bit
+        //of encoded_bits (keeping the MSB, which is the opposite of the
+        //spliced bit) and bring in a new bit on the right, once for each
+        //bit spliced out of the bounds.
+        encoded_bits = (encoded_bits & (1U<<31)) | ((encoded_bits<<underflow_bits) & ((1U<<31) - 1)) | read_bits_msb_first(underflow_bits);
+        return symbol;
+    }
+
+private:
+    /* Read num_bits bits (0 to 32) from the stream, with the first bit read as the MSB of the result */
+    u32 read_bits_msb_first(u32 num_bits){
+        return (u32)((u64)reverse_bits(stream.read_bits(num_bits))>>(32 - num_bits));
+    }
+
+    Model& model;
+    InStream& stream;
+    u32 lower_bound;
+    u32 upper_bound;
+    u32 encoded_bits;
+    bool done;
+};
+
+
+
+/* Encode the provided buffer (followed by the EOF symbol) and return the encoded bytes */
+template<typename Model>
+std::vector<u8> arith_encode_buffer(Model& model, const u8* data, std::size_t length){
+    std::vector<u8> result {};
+    {
+        WordOutputBitStream stream {result};
+        ArithEncoder<Model, WordOutputBitStream> encoder {model, stream};
+        encoder.encode(data, length);
+        encoder.finish();
+    }
+    return result;
+}
+
+/* Decode the provided encoded buffer (up to the EOF symbol) and return the decoded bytes */
+template<typename Model>
+std::vector<u8> arith_decode_buffer(Model& model, const u8* data, std::size_t length){
+    std::vector<u8> result {};
+    BufferedInputBitStream stream {data, length};
+    ArithDecoder<Model, BufferedInputBitStream> decoder {model, stream};
+    std::size_t decoded_length {0};
+    while(!decoder.finished()){
+        result.resize(decoded_length + (1<<16));
+        decoded_length += decoder.decode(result.data() + decoded_length, result.size() - decoded_length);
+    }
+    result.resize(decoded_length);
+    return result;
+}
+
+
+#endif
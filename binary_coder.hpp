@@ -0,0 +1,198 @@
+/* binary_coder.hpp
+
+   Binary range coder (in the style of the range coders of LZMA and CABAC), which
+   codes each byte as 8 binary decisions with the probabilities of a binary model
+   (see bit_tree_model.hpp), as a second coding engine alongside the multi-symbol
+   coders.
+
+   Each decision splits the current range at bound = (range >> PROBABILITY_BITS)*p
+   (where p is the probability of a 1 bit), with the lower part for a 1 and the
+   upper part for a 0. The decoder just compares its code value with the bound, so
+   it needs neither a division nor a search for the symbol whose cumulative
+   frequency range holds the code value, and updating a probability is a single
+   shift and add. The range is renormalized and carries are propagated exactly as
+   in RangeEncoder/RangeDecoder (see range_coder.hpp).
+
+   BinaryEncoder and BinaryDecoder have the same interface as the other coders.
+   Unless the model's EOF symbol has been removed, each byte is preceded by a flag
+   which is set for the EOF symbol, coded with the fixed probability BINARY_EOF_PROBABILITY
+   (which costs about 0.00035 bits per byte, and 12 bits at the end).
+*/
+
+#ifndef BINARY_CODER_HPP
+#define BINARY_CODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "input_stream.hpp"
+#include "output_stream.hpp"
+#include "bit_tree_model.hpp"
+#include "coder_stats.hpp"
+
+
+/* Probability (as a multiple of 2^-12) of the flag which marks the EOF symbol */
+inline constexpr u32 BINARY_EOF_PROBABILITY = 1;
+inline constexpr u32 BINARY_EOF_PROBABILITY_BITS = 12;
+
+
+template<BinaryModel Model, typename OutStream>
+class BinaryEncoder{
+public:
+    /* The range is renormalized whenever it drops below this value */
+    static constexpr u32 TOP = 1<<24;
+
+    /* Constructor */
+    BinaryEncoder( Model& model, OutStream& stream ): model {model}, stream {stream}, low {0}, range {~0U}, cache {0}, cache_size {1} {
+
+    }
+
+    /* Encode every byte of the provided buffer */
+    void encode(const u8* data, std::size_t length){
+        for(std::size_t i {0}; i < length; i++)
+            encode_symbol(data[i]);
+    }
+
+    /* Encode a single symbol (a byte, or the EOF symbol) */
+    void encode_symbol(u32 symbol){
+        ARITH32_STAT_CYCLES(EncodeCycles);
+        ARITH32_STAT_ADD(SymbolsEncoded, 1);
+        if (model.has_eof_symbol()){
+            encode_bit(symbol == Model::EOF_SYMBOL, BINARY_EOF_PROBABILITY, BINARY_EOF_PROBABILITY_BITS);
+            if (symbol == Model::EOF_SYMBOL)
+                return;
+        }
+        for (int i = 7; i >= 0; i--){
+            u32 bit = (symbol>>i)&1;
+            encode_bit(bit, model.probability(), Model::PROBABILITY_BITS);
+            model.update_bit(bit);
+        }
+    }
+
+    /* Encode the EOF symbol and flush the remaining bytes of low to the stream
+       (no further symbols may be encoded afterward) */
+    void finish(){
+        encode_symbol(Model::EOF_SYMBOL);
+        finish_without_eof();
+    }
+
+    /* Flush the remaining bytes of low to the stream without encoding the EOF symbol, for
+       streams whose length is stored separately (no further symbols may be encoded afterward) */
+    void finish_without_eof(){
+        for(int i = 0; i < 5; i++)
+            shift_low();
+    }
+
+private:
+    /* Encode one bit, which is a 1 with probability p/2^probability_bits */
+    void encode_bit(u32 bit, u32 p, u32 probability_bits){
+        u32 bound = (range>>probability_bits)*p;
+        if (bit){
+            range = bound;
+        }else{
+            low += bound;
+            range -= bound;
+        }
+        while(range < TOP){
+            ARITH32_STAT_ADD(RenormalizationShifts, 1);
+            range <<= 8;
+            shift_low();
+        }
+    }
+
+    /* Shift the top byte out of low (as in RangeEncoder) */
+    void shift_low(){
+        if ((u32)low < 0xff000000U || (low>>32) != 0){
+            u8 carry = low>>32;
+            u8 held_byte = cache;
+            do{
+                stream.push_byte((u8)(held_byte + carry));
+                held_byte = 0xff;
+            }while(--cache_size != 0);
+            cache = (u8)(low>>24);
+        }
+        cache_size++;
+        low = (low & 0x00ffffff)<<8;
+    }
+
+    Model& model;
+    OutStream& stream;
+    u64 low;          //33 bits are used (bit 32 is the carry)
+    u32 range;
+    u8 cache;         //The held back byte
+    u64 cache_size;   //The number of held back bytes (the cache plus a run of 0xff bytes)
+};
+
+
+
+template<BinaryModel Model, typename InStream>
+class BinaryDecoder{
+public:
+    static constexpr u32 TOP = 1<<24;
+
+    /* Constructor (reads the first 5 bytes of the encoded stream) */
+    BinaryDecoder( Model& model, InStream& stream ): model {model}, stream {stream}, code {0}, range {~0U}, done {false} {
+        //(The first byte is always 0, as for RangeDecoder)
+        for(int i = 0; i < 5; i++)
+            code = (code<<8) | stream.read_byte();
+    }
+
+    /* Decode symbols into the provided buffer until either the buffer is full or
+       the EOF symbol is reached. Returns the number of bytes written. */
+    std::size_t decode(u8* output, std::size_t capacity){
+        std::size_t length {0};
+        while(length < capacity && !done){
+            u32 symbol = decode_symbol();
+            if (symbol == Model::EOF_SYMBOL)
+                break;
+            output[length++] = symbol;
+        }
+        return length;
+    }
+
+    /* Returns true once the EOF symbol has been decoded */
+    bool finished() const{
+        return done;
+    }
+
+    /* Decode a single symbol */
+    u32 decode_symbol(){
+        ARITH32_STAT_CYCLES(DecodeCycles);
+        ARITH32_STAT_ADD(SymbolsDecoded, 1);
+        if (model.has_eof_symbol() && decode_bit(BINARY_EOF_PROBABILITY, BINARY_EOF_PROBABILITY_BITS)){
+            done = true;
+            return Model::EOF_SYMBOL;
+        }
+        u32 symbol {0};
+        for (int i = 0; i < 8; i++){
+            u32 bit = decode_bit(model.probability(), Model::PROBABILITY_BITS);
+            model.update_bit(bit);
+            symbol = 2*symbol + bit;
+        }
+        return symbol;
+    }
+
+private:
+    /* Decode one bit, which is a 1 with probability p/2^probability_bits */
+    u32 decode_bit(u32 p, u32 probability_bits){
+        u32 bound = (range>>probability_bits)*p;
+        //(Written without branches, since the bits are hard to predict)
+        u32 bit = code < bound;
+        code -= bit? 0 : bound;
+        range = bit? bound : range - bound;
+        while(range < TOP){
+            ARITH32_STAT_ADD(RenormalizationShifts, 1);
+            range <<= 8;
+            code = (code<<8) | stream.read_byte();
+        }
+        return bit;
+    }
+
+    Model& model;
+    InStream& stream;
+    u32 code;    //The offset of the encoded value from the low end of the current range
+    u32 range;
+    bool done;
+};
+
+
+#endif
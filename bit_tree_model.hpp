@@ -0,0 +1,101 @@
+/* bit_tree_model.hpp
+
+   Binary models for the binary coder in binary_coder.hpp, which codes each byte
+   as 8 binary decisions (most significant bit first) instead of as one symbol
+   of a 257-symbol alphabet.
+
+   A binary model predicts one bit at a time. It provides
+     probability()       The probability that the next bit is a 1, as a multiple of
+                         2^-PROBABILITY_BITS (always strictly between 0 and 1)
+     update_bit(bit)     Update the model with the value of the bit just coded, and
+                         move on to the next bit (the model keeps track of its own
+                         position within the byte and of any context)
+     remove_eof_symbol() As for the other models (see static_model.hpp): after this,
+     has_eof_symbol()    has_eof_symbol() returns false, and the coder does not code
+                         the flag which marks the end of the stream (see binary_coder.hpp)
+   as well as EOF_SYMBOL (256) like every other model.
+
+   BitTreeModel keeps the probabilities of a byte's bits in a binary tree with
+   255 nodes: the first bit is predicted by the root (node 1), and each following
+   bit by the node reached by the bits before it (node 2*n + bit after node n), so
+   that each of the 255 prefixes of a byte gets its own probability (as in the
+   literal coder of LZMA). Each probability is a 12 bit value which moves 1/2^ADAPTATION_SHIFT
+   of the way towards the bit coded, with a single shift and add. With Order = 1,
+   there is a separate tree for each value of the previous byte.
+*/
+
+#ifndef BIT_TREE_MODEL_HPP
+#define BIT_TREE_MODEL_HPP
+
+#include <vector>
+#include <concepts>
+#include <cstdint>
+
+/* These definitions are more reliable for fixed width types than using "int" and assuming its width */
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+
+/* Models which predict one bit at a time (see above) */
+template<typename Model>
+concept BinaryModel = requires (Model& model, u32 bit){
+    { Model::PROBABILITY_BITS } -> std::convertible_to<u32>;
+    { model.probability() } -> std::convertible_to<u32>;
+    model.update_bit(bit);
+    { model.has_eof_symbol() } -> std::convertible_to<bool>;
+};
+
+
+template<u32 Order>
+class BitTreeModel{
+    static_assert(Order <= 1, "BitTreeModel supports orders 0 and 1");
+public:
+    static constexpr u32 EOF_SYMBOL = 256;
+
+    static constexpr u32 PROBABILITY_BITS = 12;
+
+    /* Each update moves a probability 1/2^ADAPTATION_SHIFT of the way towards the bit coded */
+    static constexpr u32 ADAPTATION_SHIFT = 4;
+
+    /* Constructor (every probability starts at 1/2) */
+    BitTreeModel(): probabilities((1<<(8*Order))*256, 1<<(PROBABILITY_BITS - 1)), tree {0}, node {1}, eof {true} {
+
+    }
+
+    u32 probability() const{
+        return probabilities[tree + node];
+    }
+
+    void update_bit(u32 bit){
+        //The probabilities stay within [2^ADAPTATION_SHIFT - 1, 2^PROBABILITY_BITS - 2^ADAPTATION_SHIFT + 1]
+        //(since a step smaller than 1 rounds to 0), so neither bit ever gets a probability of 0
+        u16& p = probabilities[tree + node];
+        p += bit? ((1<<PROBABILITY_BITS) - p)>>ADAPTATION_SHIFT : -(p>>ADAPTATION_SHIFT);
+        node = 2*node + bit;
+        if (node >= 256){
+            //The byte is complete (and is node - 256)
+            if constexpr (Order == 1)
+                tree = (node - 256)*256;
+            node = 1;
+        }
+    }
+
+    bool has_eof_symbol() const{
+        return eof;
+    }
+
+    void remove_eof_symbol(){
+        eof = false;
+    }
+
+private:
+    std::vector<u16> probabilities;   //Indexed by tree + node (node 0 of each tree is unused)
+    u32 tree;    //Offset of the current context's tree
+    u32 node;    //The current node (1 to 255) of the tree
+    bool eof;
+};
+
+
+#endif
@@ -0,0 +1,260 @@
+/* block_container.hpp
+
+   Block container format: the input is split into fixed-size blocks, each of
+   which is encoded independently (with a fresh model, using the functions in
+   codec.hpp), so blocks can be encoded on many threads at once. The encoded
+   blocks are stored in order, preceded by an index of their offsets and sizes,
+   which also allows the blocks to be decoded in parallel (directly into their
+   final positions in the output) and allows any range of the original data to
+   be decoded without decoding the blocks before it.
+
+   Since the index records the decoded size of every block, the blocks are coded
+   without the EOF symbol (see StreamEnd in codec.hpp). Containers from version 1
+   of the format, whose blocks end with the EOF symbol, can still be decoded.
+
+   The index also stores a CRC32C checksum of each block's original data (see
+   crc32c.hpp), which is computed as the block is encoded and checked as it is
+   decoded, so the decoded output is verified without another pass over it.
+
+   Blocks which look incompressible (or which coding would not shrink) are stored
+   as is instead of being coded (see encode_or_store_buffer in codec.hpp). A
+   stored block is recognized by its encoded size being equal to its decoded size,
+   which a coded block is never allowed to be.
+
+   Container format (all integers little endian):
+     Offset   Size   Field
+     0        4      Magic number "A32B"
+     4        1      Format version (BLOCK_CONTAINER_VERSION)
+     5        1      Model type (a ModelType value from codec.hpp)
+     6        1      Coder type (a CoderType value from codec.hpp)
+     7        1      Flags: bit 0 (BLOCK_FLAG_CHECKSUMS) is set if the index includes
+                     checksums and bit 1 (BLOCK_FLAG_STORED_BLOCKS) is set if blocks
+                     may be stored (see above); the other bits are reserved and always 0
+     8        4      Block size (the number of input bytes in each block, except
+                     the last one, which may be shorter)
+     12       8      Number of blocks (n)
+     20       en     Block index: for each block, the offset of its encoded data
+                     from the start of the container (8 bytes), the size of the
+                     encoded data (4 bytes), the decoded size of the block (4 bytes)
+                     and, if BLOCK_FLAG_CHECKSUMS is set, the CRC32C of the decoded
+                     block (4 bytes), so each entry is e = 16 or 20 bytes long
+     20+en    ...    Encoded blocks
+*/
+
+#ifndef BLOCK_CONTAINER_HPP
+#define BLOCK_CONTAINER_HPP
+
+#include <vector>
+#include <new>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include "codec.hpp"
+#include "thread_pool.hpp"
+
+
+inline constexpr u8 BLOCK_CONTAINER_MAGIC[4] {'A', '3', '2', 'B'};
+inline constexpr u8 BLOCK_CONTAINER_VERSION = 2;
+inline constexpr std::size_t BLOCK_CONTAINER_HEADER_SIZE = 20;
+inline constexpr std::size_t BLOCK_INDEX_ENTRY_SIZE = 20;
+inline constexpr std::size_t BLOCK_INDEX_ENTRY_SIZE_NO_CHECKSUMS = 16;
+inline constexpr u8 BLOCK_FLAG_CHECKSUMS = 0x01;
+inline constexpr u8 BLOCK_FLAG_STORED_BLOCKS = 0x02;
+
+
+struct BlockIndexEntry{
+    u64 offset;        //Offset of the encoded block from the start of the container
+    u32 encoded_size;
+    u32 decoded_size;
+    u32 checksum;      //CRC32C of the decoded block (if the container has checksums)
+};
+
+struct BlockContainerHeader{
+    ModelType model;
+    CoderType coder;
+    StreamEnd block_end;  //How each block's stream ends (which depends on the version)
+    bool has_checksums;
+    bool has_stored_blocks;
+    u32 block_size;
+    std::vector<BlockIndexEntry> blocks;
+};
+
+
+/* Returns true if the buffer starts with the block container magic number */
+inline bool is_block_container(const u8* data, std::size_t length){
+    return length >= 4 && std::memcmp(data, BLOCK_CONTAINER_MAGIC, 4) == 0;
+}
+
+
+/* Split the input into blocks of block_size bytes, encode them in parallel on
+   the provided thread pool and return the resulting container */
+inline std::vector<u8> compress_blocks(const u8* data, std::size_t length, ModelType model_type, CoderType coder_type, u32 block_size, ThreadPool& pool, const ModelParameters& parameters = {}){
+    std::size_t num_blocks = (length + block_size - 1)/block_size;
+    std::vector<std::vector<u8>> encoded_blocks(num_blocks);
+    std::vector<u32> checksums(num_blocks);
+    pool.parallel_for(num_blocks, [&](std::size_t i){
+        std::size_t start = i*block_size;
+        std::size_t block_length = std::min<std::size_t>(block_size, length - start);
+        encode_or_store_buffer(model_type, coder_type, data + start, block_length, encoded_blocks.at(i), &checksums.at(i), parameters);
+    });
+
+    std::size_t header_size = BLOCK_CONTAINER_HEADER_SIZE + num_blocks*BLOCK_INDEX_ENTRY_SIZE;
+    std::size_t total_size = header_size;
+    for (const auto& block: encoded_blocks)
+        total_size += block.size();
+
+    std::vector<u8> result(total_size);
+    std::memcpy(result.data(), BLOCK_CONTAINER_MAGIC, 4);
+    result.at(4) = BLOCK_CONTAINER_VERSION;
+    result.at(5) = (u8)model_type;
+    result.at(6) = (u8)coder_type;
+    result.at(7) = BLOCK_FLAG_CHECKSUMS | BLOCK_FLAG_STORED_BLOCKS;
+    store_le(&result.at(8), block_size, 4);
+    store_le(&result.at(12), num_blocks, 8);
+    u64 offset = header_size;
+    for (std::size_t i = 0; i < num_blocks; i++){
+        u8* entry = &result.at(BLOCK_CONTAINER_HEADER_SIZE + i*BLOCK_INDEX_ENTRY_SIZE);
+        u32 decoded_size = std::min<std::size_t>(block_size, length - i*block_size);
+        store_le(entry, offset, 8);
+        store_le(entry+8, encoded_blocks.at(i).size(), 4);
+        store_le(entry+12, decoded_size, 4);
+        store_le(entry+16, checksums.at(i), 4);
+        std::memcpy(result.data() + offset, encoded_blocks.at(i).data(), encoded_blocks.at(i).size());
+        offset += encoded_blocks.at(i).size();
+    }
+    return result;
+}
+
+
+/* Parse and validate the header and block index of a container.
+   Returns false if the container is malformed or truncated. */
+inline bool read_block_container_header(const u8* data, std::size_t length, BlockContainerHeader& header){
+    if (length < BLOCK_CONTAINER_HEADER_SIZE || !is_block_container(data, length))
+        return false;
+    if ((data[4] != 1 && data[4] != BLOCK_CONTAINER_VERSION) || !is_valid_model_type(data[5]) || !is_valid_coder_type(data[6]))
+        return false;
+    header.model = (ModelType)data[5];
+    header.coder = (CoderType)data[6];
+    header.block_end = data[4] == 1? StreamEnd::EofSymbol : StreamEnd::Length;
+    if ((data[7] & ~(BLOCK_FLAG_CHECKSUMS | BLOCK_FLAG_STORED_BLOCKS)) != 0)
+        return false;
+    header.has_checksums = data[7] & BLOCK_FLAG_CHECKSUMS;
+    header.has_stored_blocks = data[7] & BLOCK_FLAG_STORED_BLOCKS;
+    std::size_t entry_size = header.has_checksums? BLOCK_INDEX_ENTRY_SIZE : BLOCK_INDEX_ENTRY_SIZE_NO_CHECKSUMS;
+    if (!coder_supports_model(header.coder, header.model))
+        return false;
+    header.block_size = load_le(data+8, 4);
+    u64 num_blocks = load_le(data+12, 8);
+    if (num_blocks > (length - BLOCK_CONTAINER_HEADER_SIZE)/entry_size)
+        return false;
+    header.blocks.resize(num_blocks);
+    for (u64 i = 0; i < num_blocks; i++){
+        const u8* entry = data + BLOCK_CONTAINER_HEADER_SIZE + i*entry_size;
+        BlockIndexEntry& block = header.blocks.at(i);
+        block.offset = load_le(entry, 8);
+        block.encoded_size = load_le(entry+8, 4);
+        block.decoded_size = load_le(entry+12, 4);
+        block.checksum = header.has_checksums? load_le(entry+16, 4) : 0;
+        if (block.offset > length || block.encoded_size > length - block.offset)
+            return false;
+        //Every block holds block_size bytes, except possibly the last (which holds at most that many)
+        if (block.decoded_size > header.block_size || (i + 1 < num_blocks && block.decoded_size != header.block_size))
+            return false;
+    }
+    return true;
+}
+
+
+/* Returns the position of each block within the decoded data, along with
+   the total decoded size (as the last element) */
+inline std::vector<u64> block_output_offsets(const BlockContainerHeader& header){
+    std::vector<u64> offsets(header.blocks.size() + 1);
+    offsets.at(0) = 0;
+    for (std::size_t i = 0; i < header.blocks.size(); i++)
+        offsets.at(i+1) = offsets.at(i) + header.blocks.at(i).decoded_size;
+    return offsets;
+}
+
+
+/* Decode blocks [first_block, last_block) of a container in parallel on the provided
+   thread pool, with each block written to output + (its decoded position - output_offsets[first_block]).
+   Returns false if any block fails to decode (or does not match its checksum). */
+inline bool decode_block_range(const u8* data, const BlockContainerHeader& header, const std::vector<u64>& output_offsets, std::size_t first_block, std::size_t last_block, u8* output, ThreadPool& pool, const ModelParameters& parameters = {}){
+    std::atomic<bool> failed {false};
+    pool.parallel_for(last_block - first_block, [&](std::size_t i){
+        std::size_t block_number = first_block + i;
+        const BlockIndexEntry& block = header.blocks.at(block_number);
+        u8* block_output = output + (output_offsets.at(block_number) - output_offsets.at(first_block));
+        u32 checksum {0};
+        u32* computed_checksum = header.has_checksums? &checksum : nullptr;
+        bool valid;
+        if (header.has_stored_blocks && block.encoded_size == block.decoded_size)
+            valid = copy_stored_buffer(data + block.offset, block.encoded_size, block_output, block.decoded_size, computed_checksum);
+        else
+            valid = decode_buffer(header.model, header.coder, data + block.offset, block.encoded_size, block_output, block.decoded_size, header.block_end, computed_checksum, parameters);
+        if (!valid)
+            failed = true;
+        else if (header.has_checksums && checksum != block.checksum)
+            failed = true;
+    });
+    return !failed;
+}
+
+
+/* Decode an entire container, with the blocks decoded in parallel on the provided
+   thread pool, and append the decoded data to output.
+   Returns false if the container is malformed or any block fails to decode. */
+inline bool decompress_blocks(const u8* data, std::size_t length, std::vector<u8>& output, ThreadPool& pool, const ModelParameters& parameters = {}){
+    BlockContainerHeader header {};
+    if (!read_block_container_header(data, length, header))
+        return false;
+    //Every block's position in the output is known from the index, so the output
+    //can be allocated up front and the blocks decoded directly into place.
+    //(The index has been validated, but a corrupt block size can still make the
+    //total too large to allocate.)
+    std::vector<u64> output_offsets = block_output_offsets(header);
+    std::size_t start = output.size();
+    try{
+        output.resize(start + output_offsets.back());
+    }catch(const std::bad_alloc&){
+        return false;
+    }
+    return decode_block_range(data, header, output_offsets, 0, header.blocks.size(), output.data() + start, pool, parameters);
+}
+
+
+/* Decode only the bytes [range_start, range_start + range_length) of the original
+   data from a container, decoding just the blocks that overlap that range, and
+   append them to output. If the range extends past the end of the data, only the
+   bytes up to the end are produced.
+   Returns false if the container is malformed or any needed block fails to decode. */
+inline bool decompress_block_range(const u8* data, std::size_t length, u64 range_start, u64 range_length, std::vector<u8>& output, ThreadPool& pool, const ModelParameters& parameters = {}){
+    BlockContainerHeader header {};
+    if (!read_block_container_header(data, length, header))
+        return false;
+    std::vector<u64> output_offsets = block_output_offsets(header);
+    u64 range_end = std::min(output_offsets.back(), range_start + std::min(range_length, ~(u64)0 - range_start));
+    if (range_start >= range_end)
+        return true;
+
+    //Find the first block which ends after range_start and the first block which starts at or after range_end
+    std::size_t first_block = std::upper_bound(output_offsets.begin(), output_offsets.end(), range_start) - output_offsets.begin() - 1;
+    std::size_t last_block = std::lower_bound(output_offsets.begin(), output_offsets.end(), range_end) - output_offsets.begin();
+
+    std::vector<u8> decoded {};
+    try{
+        decoded.resize(output_offsets.at(last_block) - output_offsets.at(first_block));
+    }catch(const std::bad_alloc&){
+        return false;
+    }
+    if (!decode_block_range(data, header, output_offsets, first_block, last_block, decoded.data(), pool, parameters))
+        return false;
+    auto range_begin = decoded.begin() + (range_start - output_offsets.at(first_block));
+    output.insert(output.end(), range_begin, range_begin + (range_end - range_start));
+    return true;
+}
+
+
+#endif
@@ -0,0 +1,187 @@
+/* cli_options.hpp
+
+   Command line options shared by arith_compress and arith_decompress.
+
+   By default, arith_compress writes a framed stream (see framed_stream.hpp), or
+   a block container in block mode (-b), both of which record the model and coder
+   used, so arith_decompress detects the format and needs no options.
+
+   With -l, the original raw stream format is used instead (a single stream ending
+   with the EOF symbol, with no header). Since a raw stream does not record which
+   model or coder was used, the same options must be given to both programs.
+   (The twopass model stores its frequency table at the start of the stream, but
+   not its own model type.) arith_decompress also decodes its input as a raw stream
+   if it is not a framed stream or block container.
+
+   The memory budget of the order2 and order3 models (-M) is only given to
+   arith_compress, since it is stored in the model's header in every format.
+   Huge pages (-H) can be requested by either program.
+*/
+
+#ifndef CLI_OPTIONS_HPP
+#define CLI_OPTIONS_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "codec.hpp"
+
+
+struct CodecOptions{
+    ModelType model {ModelType::Static};
+    CoderType coder {CoderType::Arith};
+    u32 block_size {0};   //If nonzero, use the block container format with this block size
+    u32 threads {0};      //Number of threads for block mode (0 = one per hardware thread)
+    u64 range_start {0};  //Range of the original data to decode in block mode (arith_decompress only)
+    u64 range_length {~(u64)0};
+    bool raw_stream {false};  //Use the raw stream format (with the EOF symbol and no header)
+    ModelParameters model_parameters {};
+};
+
+
+/* Print a usage message for the program to std::cerr */
+inline void print_usage(const char* program_name){
+    std::cerr << "Usage: " << program_name << " [-m model] [-c coder] [-M memory] [-H] [-l | -b block_size [-t threads]] < input > output" << std::endl;
+    std::cerr << "  -m model        Probability model (default: static). One of:";
+    for (const auto& entry: MODEL_NAMES)
+        std::cerr << " " << entry.name;
+    std::cerr << std::endl;
+    std::cerr << "  -c coder        Entropy coder (default: arith). One of:";
+    for (const auto& entry: CODER_NAMES)
+        std::cerr << " " << entry.name;
+    std::cerr << std::endl;
+    std::cerr << "  -M memory       Memory budget of the order2 and order3 models' tables (default: 16M)," << std::endl;
+    std::cerr << "                  from 1M to 1G (in bytes, or with a K, M or G suffix)" << std::endl;
+    std::cerr << "  -H              Back the order2 and order3 models' tables with huge pages" << std::endl;
+    std::cerr << "  -l              Use the raw stream format (which does not record the model" << std::endl;
+    std::cerr << "                  or coder, so both programs must be given the same options)" << std::endl;
+    std::cerr << "  -b block_size   Code the input as independent blocks of this size" << std::endl;
+    std::cerr << "                  (in bytes, or with a K or M suffix), in parallel" << std::endl;
+    std::cerr << "  -t threads      Number of threads for block mode (default: all hardware threads)" << std::endl;
+    std::cerr << "  -r start:length (arith_decompress only) Only output the given range of the" << std::endl;
+    std::cerr << "                  original data (in block mode, only the blocks holding it are" << std::endl;
+    std::cerr << "                  decoded); not available for raw streams" << std::endl;
+}
+
+/* Parse a size with an optional K, M or G suffix (e.g. 64K). Returns 0 if the size is invalid. */
+inline u64 parse_size(const std::string& text){
+    std::size_t end {0};
+    u64 value {0};
+    try{
+        value = std::stoull(text, &end);
+    }catch(...){
+        return 0;
+    }
+    std::string suffix = text.substr(end);
+    if (suffix == "K" || suffix == "k")
+        value <<= 10;
+    else if (suffix == "M" || suffix == "m")
+        value <<= 20;
+    else if (suffix == "G" || suffix == "g")
+        value <<= 30;
+    else if (!suffix.empty())
+        return 0;
+    return value;
+}
+
+/* Parse the command line into options. Returns false (after printing a usage
+   message) if the command line is invalid. */
+inline bool parse_options(int argc, char** argv, CodecOptions& options){
+    for (int i = 1; i < argc; i++){
+        std::string arg {argv[i]};
+        if (arg == "-m" && i+1 < argc){
+            std::string name {argv[++i]};
+            bool found = false;
+            for (const auto& entry: MODEL_NAMES){
+                if (name == entry.name){
+                    options.model = entry.type;
+                    found = true;
+                }
+            }
+            if (!found){
+                std::cerr << "Unknown model: " << name << std::endl;
+                print_usage(argv[0]);
+                return false;
+            }
+        }else if (arg == "-c" && i+1 < argc){
+            std::string name {argv[++i]};
+            bool found = false;
+            for (const auto& entry: CODER_NAMES){
+                if (name == entry.name){
+                    options.coder = entry.type;
+                    found = true;
+                }
+            }
+            if (!found){
+                std::cerr << "Unknown coder: " << name << std::endl;
+                print_usage(argv[0]);
+                return false;
+            }
+        }else if (arg == "-b" && i+1 < argc){
+            u64 size = parse_size(argv[++i]);
+            if (size == 0 || size > 0xffffffff){
+                std::cerr << "Invalid block size: " << argv[i] << std::endl;
+                print_usage(argv[0]);
+                return false;
+            }
+            options.block_size = size;
+        }else if (arg == "-M" && i+1 < argc){
+            u64 size = parse_size(argv[++i]);
+            if (size < (1<<20) || size > (1<<30)){
+                std::cerr << "Invalid memory budget: " << argv[i] << std::endl;
+                print_usage(argv[0]);
+                return false;
+            }
+            options.model_parameters.memory_budget = size;
+        }else if (arg == "-H"){
+            options.model_parameters.huge_pages = true;
+        }else if (arg == "-l"){
+            options.raw_stream = true;
+        }else if (arg == "-t" && i+1 < argc){
+            u64 threads = parse_size(argv[++i]);
+            if (threads == 0 || threads > 4096){
+                std::cerr << "Invalid thread count: " << argv[i] << std::endl;
+                print_usage(argv[0]);
+                return false;
+            }
+            options.threads = threads;
+        }else if (arg == "-r" && i+1 < argc){
+            std::string range {argv[++i]};
+            std::size_t colon = range.find(':');
+            u64 length {0};
+            if (colon != std::string::npos && (range.substr(0, colon) == "0" || parse_size(range.substr(0, colon)) != 0))
+                length = parse_size(range.substr(colon+1));
+            if (length == 0){
+                std::cerr << "Invalid range: " << range << std::endl;
+                print_usage(argv[0]);
+                return false;
+            }
+            options.range_start = parse_size(range.substr(0, colon));
+            options.range_length = length;
+        }else{
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    if (!coder_supports_model(options.coder, options.model)){
+        std::cerr << "The rans coder requires a static power-of-two model (static-pow2 or twopass)," << std::endl;
+        std::cerr << "the rans-x8, rans-x16, rans-x32 and tans coders require a static model," << std::endl;
+        std::cerr << "and the binary coder and the binary models (bittree, bittree-o1 and the +apm models) can only be used with each other" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+/* Read the entire contents of the provided stream */
+inline std::vector<u8> read_input(std::istream& input_stream){
+    std::vector<u8> input {};
+    std::vector<u8> buffer(1<<16);
+    while(input_stream.read((char*)buffer.data(), buffer.size()) || input_stream.gcount() > 0)
+        input.insert(input.end(), buffer.begin(), buffer.begin() + input_stream.gcount());
+    return input;
+}
+
+
+#endif
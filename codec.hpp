@@ -0,0 +1,581 @@
+/* codec.hpp
+
+   Encoding and decoding of complete in-memory buffers with any of the
+   available probability models and coders, selected at runtime by ModelType
+   and CoderType values.
+
+   Each encoded buffer is a self-contained stream: it starts with any header
+   needed by the model (see write_header/read_header below), so buffers encoded
+   with this interface can be decoded independently of each other (e.g. by
+   different threads). How the decoder finds the end of the stream is chosen
+   by a StreamEnd value: either the stream is terminated by the EOF symbol (the
+   original raw stream format), or its length is stored elsewhere (as in the
+   framed and block container formats) and the EOF symbol is removed from the
+   alphabet entirely. (The interleaved rANS and tANS coders also store the number
+   of symbols themselves in either case.)
+*/
+
+#ifndef CODEC_HPP
+#define CODEC_HPP
+
+#include <vector>
+#include <new>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <type_traits>
+#include <stdexcept>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "input_stream.hpp"
+#include "output_stream.hpp"
+#include "static_model.hpp"
+#include "adaptive_model.hpp"
+#include "two_pass_model.hpp"
+#include "order1_model.hpp"
+#include "hashed_context_model.hpp"
+#include "bit_tree_model.hpp"
+#include "apm_model.hpp"
+#include "arith_coder.hpp"
+#include "interleaved_arith_coder.hpp"
+#include "range_coder.hpp"
+#include "rans_coder.hpp"
+#include "rans_interleaved.hpp"
+#include "tans_coder.hpp"
+#include "binary_coder.hpp"
+#include "crc32c.hpp"
+#include "histogram.hpp"
+
+
+/* How the decoder finds the end of an encoded stream */
+enum class StreamEnd{
+    EofSymbol,   //The stream is terminated by the EOF symbol
+    Length,      //The length of the original data is stored separately, so the EOF
+                 //symbol is removed from the alphabet (see Model::remove_eof_symbol)
+};
+
+
+/* Little endian integer access for the container headers */
+inline void store_le(u8* destination, u64 value, u32 num_bytes){
+    for (u32 i {0}; i < num_bytes; i++)
+        destination[i] = (u8)(value>>(8*i));
+}
+inline u64 load_le(const u8* source, u32 num_bytes){
+    u64 result {0};
+    for (u32 i {0}; i < num_bytes; i++)
+        result |= (u64)source[i]<<(8*i);
+    return result;
+}
+
+
+/* Probability models (the values are stored in block container headers, so they must not change) */
+enum class ModelType: u8{
+    Static = 0,       //The placeholder static frequency table (StaticModel)
+    StaticPow2 = 1,   //The same table normalized to a power-of-two total (PowerOfTwoStaticModel)
+    Adaptive = 2,     //Adaptive order-0 model (AdaptiveModel)
+    TwoPass = 3,      //Static model built from the input's histogram (TwoPassModel)
+    Order1 = 4,       //Adaptive order-1 context model (Order1Model)
+    Order2 = 5,       //Hashed order-2 and order-3 context models
+    Order3 = 6,       //(HashedContextModel<2> and HashedContextModel<3>)
+    BitTree = 7,      //Binary order-0 and order-1 bit tree models (BitTreeModel<0>
+    BitTreeOrder1 = 8,//and BitTreeModel<1>), binary coder only
+                      //(9 is reserved for a context mixing model)
+    BitTreeApm = 10,  //The bit tree models refined by an adaptive probability map
+    BitTreeOrder1Apm = 11, //(ApmModel<BitTreeModel<0>> and ApmModel<BitTreeModel<1>>), binary coder only
+    AdaptiveApm = 12, //The adaptive models coded one bit at a time and refined by an
+    Order1Apm = 13,   //adaptive probability map (ApmModel<BinarizedModel<AdaptiveModel>>,
+    Order2Apm = 14,   //ApmModel<BinarizedModel<Order1Model>> and so on), binary coder only
+    Order3Apm = 15,
+};
+
+struct ModelName{
+    ModelType type;
+    const char* name;
+};
+
+inline constexpr ModelName MODEL_NAMES[] {
+    {ModelType::Static, "static"},
+    {ModelType::StaticPow2, "static-pow2"},
+    {ModelType::Adaptive, "adaptive"},
+    {ModelType::TwoPass, "twopass"},
+    {ModelType::Order1, "order1"},
+    {ModelType::Order2, "order2"},
+    {ModelType::Order3, "order3"},
+    {ModelType::BitTree, "bittree"},
+    {ModelType::BitTreeOrder1, "bittree-o1"},
+    {ModelType::BitTreeApm, "bittree+apm"},
+    {ModelType::BitTreeOrder1Apm, "bittree-o1+apm"},
+    {ModelType::AdaptiveApm, "adaptive+apm"},
+    {ModelType::Order1Apm, "order1+apm"},
+    {ModelType::Order2Apm, "order2+apm"},
+    {ModelType::Order3Apm, "order3+apm"},
+};
+
+/* Returns true if the value is one of the ModelType values above */
+inline bool is_valid_model_type(u8 value){
+    for (const auto& entry: MODEL_NAMES)
+        if ((u8)entry.type == value)
+            return true;
+    return false;
+}
+
+
+/* Coders (the values are stored in block container headers, so they must not change) */
+enum class CoderType: u8{
+    Arith = 0,        //Bitwise arithmetic coder (ArithEncoder/ArithDecoder)
+    Range = 1,        //Byte-oriented range coder (RangeEncoder/RangeDecoder)
+    Rans = 2,         //rANS coder (RansEncoder/RansDecoder), static power-of-two models only
+    RansX8 = 3,       //Interleaved rANS coder with 8, 16 or 32 states (InterleavedRansEncoder/
+    RansX16 = 4,      //InterleavedRansDecoder), static models only
+    RansX32 = 5,
+    Tans = 6,         //Table-driven tANS coder (TansEncoder/TansDecoder), static models only
+    ArithX2 = 7,      //Arithmetic coder with 2 interleaved streams (InterleavedArithEncoder/
+                      //InterleavedArithDecoder). 8 was a 4-stream version, which was no faster.
+    Binary = 9,       //Binary range coder (BinaryEncoder/BinaryDecoder), binary models only
+};
+
+struct CoderName{
+    CoderType type;
+    const char* name;
+};
+
+inline constexpr CoderName CODER_NAMES[] {
+    {CoderType::Arith, "arith"},
+    {CoderType::Range, "range"},
+    {CoderType::Rans, "rans"},
+    {CoderType::RansX8, "rans-x8"},
+    {CoderType::RansX16, "rans-x16"},
+    {CoderType::RansX32, "rans-x32"},
+    {CoderType::Tans, "tans"},
+    {CoderType::ArithX2, "arith-x2"},
+    {CoderType::Binary, "binary"},
+};
+
+/* Returns true if the value is one of the CoderType values above */
+inline bool is_valid_coder_type(u8 value){
+    for (const auto& entry: CODER_NAMES)
+        if ((u8)entry.type == value)
+            return true;
+    return false;
+}
+
+
+/* Returns true if models of the given type have a fixed frequency table (StaticFrequencyModel) */
+inline bool model_is_static(ModelType model_type){
+    return model_type == ModelType::Static || model_type == ModelType::StaticPow2 || model_type == ModelType::TwoPass;
+}
+
+/* Returns true if models of the given type predict one bit at a time (BinaryModel) */
+inline bool model_is_binary(ModelType model_type){
+    return model_type == ModelType::BitTree || model_type == ModelType::BitTreeOrder1
+        || model_type == ModelType::BitTreeApm || model_type == ModelType::BitTreeOrder1Apm
+        || model_type == ModelType::AdaptiveApm || model_type == ModelType::Order1Apm
+        || model_type == ModelType::Order2Apm || model_type == ModelType::Order3Apm;
+}
+
+/* Returns true if the given coder can be used with the given model */
+inline bool coder_supports_model(CoderType coder_type, ModelType model_type){
+    //The binary coder is the only coder for the binary models (and vice versa)
+    if (coder_type == CoderType::Binary || model_is_binary(model_type))
+        return coder_type == CoderType::Binary && model_is_binary(model_type);
+    if (coder_type == CoderType::Rans)
+        return model_type == ModelType::StaticPow2 || model_type == ModelType::TwoPass;
+    if (coder_type == CoderType::RansX8 || coder_type == CoderType::RansX16 || coder_type == CoderType::RansX32 || coder_type == CoderType::Tans)
+        return model_is_static(model_type);
+    return true;
+}
+
+/* Returns true if models of the given type are built from the data to be encoded
+   (so the data must be available in full before encoding starts) */
+inline bool model_needs_input(ModelType model_type){
+    return model_type == ModelType::TwoPass;
+}
+
+
+/* Parameters for the models which have any. Parameters which the decoder needs
+   (like the size of a hashed context model's table) are stored in the model's
+   header, so the decoder only uses the others (like huge_pages). */
+struct ModelParameters{
+    u64 memory_budget {HashedContextModel<2>::DEFAULT_MEMORY_BUDGET};  //Of the hashed context models' tables, in bytes
+    bool huge_pages {false};     //Back those tables with huge pages
+};
+
+
+/* Call f(model) with a newly constructed model of the given type. Models which are
+   built from the data to be encoded (like TwoPassModel) provide a build(data, length)
+   member function, and models with parameters which the decoder needs (like TwoPassModel
+   and HashedContextModel) provide write_header/read_header to store them. */
+template<typename F>
+inline auto with_model(ModelType model_type, F&& f, const ModelParameters& parameters = {}){
+    switch(model_type){
+        case ModelType::StaticPow2:{
+            PowerOfTwoStaticModel<> model {};
+            return f(model);
+        }
+        case ModelType::Adaptive:{
+            AdaptiveModel model {};
+            return f(model);
+        }
+        case ModelType::TwoPass:{
+            TwoPassModel model {};
+            return f(model);
+        }
+        case ModelType::Order1:{
+            Order1Model model {};
+            return f(model);
+        }
+        case ModelType::Order2:{
+            HashedContextModel<2> model {parameters.memory_budget, parameters.huge_pages};
+            return f(model);
+        }
+        case ModelType::Order3:{
+            HashedContextModel<3> model {parameters.memory_budget, parameters.huge_pages};
+            return f(model);
+        }
+        case ModelType::BitTree:{
+            BitTreeModel<0> model {};
+            return f(model);
+        }
+        case ModelType::BitTreeOrder1:{
+            BitTreeModel<1> model {};
+            return f(model);
+        }
+        case ModelType::BitTreeApm:{
+            ApmModel<BitTreeModel<0>> model {};
+            return f(model);
+        }
+        case ModelType::BitTreeOrder1Apm:{
+            ApmModel<BitTreeModel<1>> model {};
+            return f(model);
+        }
+        case ModelType::AdaptiveApm:{
+            ApmModel<BinarizedModel<AdaptiveModel>> model {};
+            return f(model);
+        }
+        case ModelType::Order1Apm:{
+            ApmModel<BinarizedModel<Order1Model>> model {};
+            return f(model);
+        }
+        case ModelType::Order2Apm:{
+            ApmModel<BinarizedModel<HashedContextModel<2>>> model {parameters.memory_budget, parameters.huge_pages};
+            return f(model);
+        }
+        case ModelType::Order3Apm:{
+            ApmModel<BinarizedModel<HashedContextModel<3>>> model {parameters.memory_budget, parameters.huge_pages};
+            return f(model);
+        }
+        case ModelType::Static:
+        default:{
+            StaticModel model {};
+            return f(model);
+        }
+    }
+}
+
+
+/* Throw an exception for a coder which with_encoder or with_decoder can't construct
+   for the model (a combination which coder_supports_model rejects) */
+[[noreturn]] inline void unsupported_coder(CoderType coder_type){
+    throw std::invalid_argument("Coder type " + std::to_string((u32)coder_type) + " can't be used with this model");
+}
+
+/* Call f(encoder) with a newly constructed encoder of the given type
+   (throwing std::invalid_argument unless coder_supports_model allows the combination of
+   coder and model) */
+template<typename Model, typename OutStream, typename F>
+inline auto with_encoder(CoderType coder_type, Model& model, OutStream& stream, F&& f){
+    //Binary models can only be used with the binary coder (and no other coder can be instantiated for them)
+    if constexpr (BinaryModel<Model>){
+        if (coder_type != CoderType::Binary)
+            unsupported_coder(coder_type);
+        BinaryEncoder<Model, OutStream> encoder {model, stream};
+        return f(encoder);
+    }else switch(coder_type){
+        case CoderType::ArithX2:{
+            InterleavedArithEncoder<Model, OutStream, 2> encoder {model, stream};
+            return f(encoder);
+        }
+        case CoderType::Tans:
+            if constexpr (StaticFrequencyModel<Model>){
+                TansEncoder<Model, OutStream> encoder {model, stream};
+                return f(encoder);
+            }
+            unsupported_coder(coder_type);
+        case CoderType::RansX8:
+            if constexpr (StaticFrequencyModel<Model>){
+                InterleavedRansEncoder<Model, OutStream, 8> encoder {model, stream};
+                return f(encoder);
+            }
+            unsupported_coder(coder_type);
+        case CoderType::RansX16:
+            if constexpr (StaticFrequencyModel<Model>){
+                InterleavedRansEncoder<Model, OutStream, 16> encoder {model, stream};
+                return f(encoder);
+            }
+            unsupported_coder(coder_type);
+        case CoderType::RansX32:
+            if constexpr (StaticFrequencyModel<Model>){
+                InterleavedRansEncoder<Model, OutStream, 32> encoder {model, stream};
+                return f(encoder);
+            }
+            unsupported_coder(coder_type);
+        case CoderType::Rans:
+            if constexpr (RansModel<Model>){
+                RansEncoder<Model, OutStream> encoder {model, stream};
+                return f(encoder);
+            }
+            unsupported_coder(coder_type);
+        case CoderType::Range:{
+            RangeEncoder<Model, OutStream> encoder {model, stream};
+            return f(encoder);
+        }
+        case CoderType::Arith:{
+            ArithEncoder<Model, OutStream> encoder {model, stream};
+            return f(encoder);
+        }
+        default:
+            unsupported_coder(coder_type);
+    }
+}
+
+/* Call f(decoder) with a newly constructed decoder of the given type
+   (throwing std::invalid_argument unless coder_supports_model allows the combination of
+   coder and model) */
+template<typename Model, typename InStream, typename F>
+inline auto with_decoder(CoderType coder_type, Model& model, InStream& stream, F&& f){
+    if constexpr (BinaryModel<Model>){
+        if (coder_type != CoderType::Binary)
+            unsupported_coder(coder_type);
+        BinaryDecoder<Model, InStream> decoder {model, stream};
+        return f(decoder);
+    }else switch(coder_type){
+        case CoderType::ArithX2:{
+            InterleavedArithDecoder<Model, InStream, 2> decoder {model, stream};
+            return f(decoder);
+        }
+        case CoderType::Tans:
+            if constexpr (StaticFrequencyModel<Model>){
+                TansDecoder<Model, InStream> decoder {model, stream};
+                return f(decoder);
+            }
+            unsupported_coder(coder_type);
+        case CoderType::RansX8:
+            if constexpr (StaticFrequencyModel<Model>){
+                InterleavedRansDecoder<Model, InStream, 8> decoder {model, stream};
+                return f(decoder);
+            }
+            unsupported_coder(coder_type);
+        case CoderType::RansX16:
+            if constexpr (StaticFrequencyModel<Model>){
+                InterleavedRansDecoder<Model, InStream, 16> decoder {model, stream};
+                return f(decoder);
+            }
+            unsupported_coder(coder_type);
+        case CoderType::RansX32:
+            if constexpr (StaticFrequencyModel<Model>){
+                InterleavedRansDecoder<Model, InStream, 32> decoder {model, stream};
+                return f(decoder);
+            }
+            unsupported_coder(coder_type);
+        case CoderType::Rans:
+            if constexpr (RansModel<Model>){
+                RansDecoder<Model, InStream> decoder {model, stream};
+                return f(decoder);
+            }
+            unsupported_coder(coder_type);
+        case CoderType::Range:{
+            RangeDecoder<Model, InStream> decoder {model, stream};
+            return f(decoder);
+        }
+        case CoderType::Arith:{
+            ArithDecoder<Model, InStream> decoder {model, stream};
+            return f(decoder);
+        }
+        default:
+            unsupported_coder(coder_type);
+    }
+}
+
+
+/* The data is passed to the coders (and checksummed) in chunks of this size, so that
+   each chunk is still in the cache when it is checksummed */
+inline constexpr std::size_t CODEC_CHUNK_SIZE = 1<<16;
+
+
+/* Encode the provided buffer with the given model and coder types (followed by the
+   EOF symbol if end is StreamEnd::EofSymbol), appending the result to output.
+   If checksum is provided, the CRC32C of the data is also computed (in the same
+   pass as the encoding) and stored there. */
+inline void encode_buffer(ModelType model_type, CoderType coder_type, const u8* data, std::size_t length, std::vector<u8>& output, StreamEnd end = StreamEnd::Length, u32* checksum = nullptr, const ModelParameters& parameters = {}){
+    with_model(model_type, [&](auto& model){
+        WordOutputBitStream stream {output};
+        if (end == StreamEnd::Length)
+            model.remove_eof_symbol();
+        if constexpr (requires { model.build(data, length); })
+            model.build(data, length);
+        //Models with parameters store them first
+        if constexpr (requires { model.write_header(stream); })
+            model.write_header(stream);
+        with_encoder(coder_type, model, stream, [&](auto& encoder){
+            u32 crc {0};
+            for (std::size_t i {0}; i < length; i += CODEC_CHUNK_SIZE){
+                std::size_t chunk_length = std::min(CODEC_CHUNK_SIZE, length - i);
+                if (checksum)
+                    crc = crc32c(data + i, chunk_length, crc);
+                encoder.encode(data + i, chunk_length);
+            }
+            if (checksum)
+                *checksum = crc;
+            //(The coders without finish_without_eof never encode the EOF symbol)
+            if constexpr (requires { encoder.finish_without_eof(); }){
+                if (end == StreamEnd::Length){
+                    encoder.finish_without_eof();
+                    return;
+                }
+            }
+            encoder.finish();
+        });
+    }, parameters);
+}
+
+/* The coders' finish functions flush enough bytes for their decoders' lookahead, so a
+   decoder does not read past the end of a valid stream (this allows a few bytes
+   regardless); one which has read further is decoding a corrupt stream (e.g. one
+   whose stored length is too large) */
+inline constexpr u64 MAX_BYTES_PAST_END = 8;
+
+/* Returns the number of bytes which the decoder has read past the end of its input
+   (decoders which read their input through buffers or streams of their own report this
+   themselves) */
+template<typename Decoder, typename InStream>
+inline u64 decoder_bytes_past_end(const Decoder& decoder, const InStream& stream){
+    u64 bytes_past_end = stream.bytes_past_end();
+    if constexpr (requires { decoder.bytes_past_end(); })
+        bytes_past_end = std::max(bytes_past_end, decoder.bytes_past_end());
+    return bytes_past_end;
+}
+
+/* Decode length bytes from the provided encoded buffer, one chunk at a time, into the
+   memory given by output_chunk(offset, chunk_length) for each chunk (or stop, if it
+   returns nullptr). Returns false if the encoded buffer does not decode to exactly
+   length bytes. (See decode_buffer for the other arguments.) */
+template<typename ChunkOutput>
+inline bool decode_buffer_chunks(ModelType model_type, CoderType coder_type, const u8* encoded, std::size_t encoded_length, u64 length, StreamEnd end, u32* checksum, const ModelParameters& parameters, ChunkOutput&& output_chunk){
+    return with_model(model_type, [&](auto& model){
+        BufferedInputBitStream stream {encoded, encoded_length};
+        if (end == StreamEnd::Length)
+            model.remove_eof_symbol();
+        if constexpr (requires { model.read_header(stream); })
+            model.read_header(stream);
+        return with_decoder(coder_type, model, stream, [&](auto& decoder){
+            u32 crc {0};
+            for (u64 i {0}; i < length; i += CODEC_CHUNK_SIZE){
+                std::size_t chunk_length = std::min<u64>(CODEC_CHUNK_SIZE, length - i);
+                u8* output = output_chunk(i, chunk_length);
+                if (!output || decoder.decode(output, chunk_length) != chunk_length)
+                    return false;
+                if (decoder_bytes_past_end(decoder, stream) > MAX_BYTES_PAST_END)
+                    return false;
+                if (checksum)
+                    crc = crc32c(output, chunk_length, crc);
+            }
+            if (checksum)
+                *checksum = crc;
+            if (end == StreamEnd::Length)
+                return true;
+            using Model = std::remove_reference_t<decltype(model)>;
+            return decoder.decode_symbol() == Model::EOF_SYMBOL;
+        });
+    }, parameters);
+}
+
+/* Decode exactly length bytes into output from the provided encoded buffer (produced
+   by encode_buffer with the same model, coder and end types). Returns false if the encoded
+   buffer does not decode to exactly length bytes (followed by the EOF symbol if end is
+   StreamEnd::EofSymbol). If checksum is provided, the CRC32C of the decoded data is
+   also computed (in the same pass as the decoding) and stored there. */
+inline bool decode_buffer(ModelType model_type, CoderType coder_type, const u8* encoded, std::size_t encoded_length, u8* output, std::size_t length, StreamEnd end = StreamEnd::Length, u32* checksum = nullptr, const ModelParameters& parameters = {}){
+    return decode_buffer_chunks(model_type, coder_type, encoded, encoded_length, length, end, checksum, parameters, [&](u64 offset, std::size_t){
+        return output + offset;
+    });
+}
+
+/* Decode length bytes as decode_buffer does, appending them to output. The output grows
+   as the data is decoded instead of being allocated in full first, so a corrupt length
+   fails to decode (or fails to allocate) without ever allocating much more than the data
+   actually decoded. Returns false (leaving output as it was) if decoding fails. */
+inline bool decode_buffer_append(ModelType model_type, CoderType coder_type, const u8* encoded, std::size_t encoded_length, std::vector<u8>& output, u64 length, StreamEnd end = StreamEnd::Length, u32* checksum = nullptr, const ModelParameters& parameters = {}){
+    std::size_t start = output.size();
+    bool valid = decode_buffer_chunks(model_type, coder_type, encoded, encoded_length, length, end, checksum, parameters, [&](u64 offset, std::size_t chunk_length) -> u8*{
+        try{
+            output.resize(start + offset + chunk_length);
+        }catch(const std::bad_alloc&){
+            return nullptr;
+        }
+        return output.data() + start + offset;
+    });
+    if (!valid)
+        output.resize(start);
+    return valid;
+}
+
+
+/* Data whose estimated entropy is above this many bits per byte is stored without
+   being coded, since coding it would save a fraction of a percent at best */
+inline constexpr double STORED_ENTROPY_THRESHOLD = 7.97;
+
+/* Returns true if the data looks incompressible (e.g. already compressed or
+   encrypted data), judging by the order-0 entropy of a sample of it. This only
+   costs a histogram of (at most) 64KB of the data. */
+inline bool looks_incompressible(const u8* data, std::size_t length){
+    ByteHistogram histogram = sampled_byte_histogram(data, length);
+    u64 sample_length {0};
+    u32 distinct_bytes {0};
+    for (u64 count: histogram){
+        sample_length += count;
+        distinct_bytes += (count != 0);
+    }
+    if (sample_length == 0)
+        return true;
+    //The entropy of a sample underestimates the entropy of its source (e.g. a 4KB
+    //sample of random bytes measures about 7.96 bits per byte), so the estimate is
+    //corrected for the sample size (with the Miller-Madow correction)
+    double entropy = histogram_entropy(histogram) + (distinct_bytes - 1)/(2*sample_length*std::log(2.0));
+    return entropy > STORED_ENTROPY_THRESHOLD;
+}
+
+/* Encode the provided buffer as encode_buffer does (with StreamEnd::Length), unless the
+   data looks incompressible or its encoding is no smaller than the data itself, in which
+   case the data is appended to output as is (a stored buffer, decoded by copy_stored_buffer).
+   This ensures that the output never grows by more than length bytes.
+   Returns true if the data was stored. */
+inline bool encode_or_store_buffer(ModelType model_type, CoderType coder_type, const u8* data, std::size_t length, std::vector<u8>& output, u32* checksum = nullptr, const ModelParameters& parameters = {}){
+    std::size_t start = output.size();
+    if (!looks_incompressible(data, length)){
+        encode_buffer(model_type, coder_type, data, length, output, StreamEnd::Length, checksum, parameters);
+        if (output.size() - start < length)
+            return false;
+        //Coding didn't help after all
+        output.resize(start);
+    }
+    output.insert(output.end(), data, data + length);
+    if (checksum)
+        *checksum = crc32c(data, length);
+    return true;
+}
+
+/* Copy a stored buffer (see encode_or_store_buffer) into output, which must have room for
+   length bytes. Returns false if the stored buffer is not exactly length bytes long. If
+   checksum is provided, the CRC32C of the data is also stored there. */
+inline bool copy_stored_buffer(const u8* stored, std::size_t stored_length, u8* output, std::size_t length, u32* checksum = nullptr){
+    if (stored_length != length)
+        return false;
+    std::memcpy(output, stored, length);
+    if (checksum)
+        *checksum = crc32c(output, length);
+    return true;
+}
+
+
+#endif
@@ -0,0 +1,181 @@
+/* coder_stats.hpp
+
+   Optional instrumentation counters for the coding loops, compiled in only
+   when ARITH32_STATS is defined (e.g. make EXTRA_CXXFLAGS=-DARITH32_STATS),
+   so that a normal build has no overhead at all.
+
+   The counters are updated through the ARITH32_STAT_* macros below (which
+   expand to nothing otherwise). Each thread counts into its own thread_local
+   set of counters, which is merged into the process-wide totals when the thread
+   exits, and the totals are written to std::cerr as a single JSON object when
+   the program exits:
+     symbols_encoded, symbols_decoded
+     renormalization_shifts   Bits shifted out of/into the arithmetic coder's bounds,
+                              bytes shifted by the range coder, or 16 bit words
+                              shifted by the rANS coders
+     underflow_events         Underflow (E3) bits spliced out by the arithmetic coder
+     max_underflow_run        The largest number of underflow bits pending at once
+     search_calls, search_iterations
+                              Calls to Model::find_symbol, and the number of lookup or
+                              binary search steps (or tree levels) they took
+     bytes_read, bytes_written
+                              Bytes consumed from input bit streams and produced by
+                              output bit streams
+     encode_cycles, decode_cycles
+                              Cycles (rdtsc) spent encoding/decoding symbols, which
+                              include the following three (and per-symbol averages)
+     search_cycles            Cycles spent in Model::find_symbol
+     model_cycles             Cycles spent in Model::update
+     io_cycles                Cycles spent reading from std::istream or writing to
+                              std::ostream (or a vector) by the bit streams
+   Timing each symbol adds some overhead of its own, so the cycle counts are
+   best used to compare the phases with each other.
+*/
+
+#ifndef CODER_STATS_HPP
+#define CODER_STATS_HPP
+
+#include <cstdint>
+
+/* These definitions are more reliable for fixed width types than using "int" and assuming its width */
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+#ifdef ARITH32_STATS
+
+#include <iostream>
+#include <array>
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+enum class Stat: u32{
+    SymbolsEncoded,
+    SymbolsDecoded,
+    RenormalizationShifts,
+    UnderflowEvents,
+    MaxUnderflowRun,
+    SearchCalls,
+    SearchIterations,
+    BytesRead,
+    BytesWritten,
+    EncodeCycles,
+    DecodeCycles,
+    SearchCycles,
+    ModelCycles,
+    IoCycles,
+    Count
+};
+
+inline constexpr const char* STAT_NAMES[(u32)Stat::Count] {
+    "symbols_encoded", "symbols_decoded", "renormalization_shifts", "underflow_events", "max_underflow_run",
+    "search_calls", "search_iterations", "bytes_read", "bytes_written",
+    "encode_cycles", "decode_cycles", "search_cycles", "model_cycles", "io_cycles",
+};
+
+using StatCounters = std::array<u64, (u32)Stat::Count>;
+
+
+/* Merge one set of counters into another (the maximums are combined with max, everything else is summed) */
+inline void merge_stats(StatCounters& total, const StatCounters& counters){
+    for (u32 i {0}; i < (u32)Stat::Count; i++){
+        if (i == (u32)Stat::MaxUnderflowRun)
+            total[i] = std::max(total[i], counters[i]);
+        else
+            total[i] += counters[i];
+    }
+}
+
+/* The process-wide totals (printed when the program exits) */
+class StatRegistry{
+public:
+    ~StatRegistry(){
+        auto value = [&](Stat stat){ return totals[(u32)stat]; };
+        auto per_symbol = [&](Stat cycles, Stat symbols){ return value(symbols)? (double)value(cycles)/value(symbols) : 0.0; };
+        std::cerr << "{";
+        for (u32 i {0}; i < (u32)Stat::Count; i++)
+            std::cerr << (i? ", " : "") << "\"" << STAT_NAMES[i] << "\": " << totals[i];
+        std::cerr << ", \"encode_cycles_per_symbol\": " << per_symbol(Stat::EncodeCycles, Stat::SymbolsEncoded);
+        std::cerr << ", \"decode_cycles_per_symbol\": " << per_symbol(Stat::DecodeCycles, Stat::SymbolsDecoded);
+        std::cerr << "}" << std::endl;
+    }
+    void merge(const StatCounters& counters){
+        std::lock_guard<std::mutex> lock {mutex};
+        merge_stats(totals, counters);
+    }
+private:
+    std::mutex mutex {};
+    StatCounters totals {};
+};
+
+inline StatRegistry& stat_registry(){
+    static StatRegistry registry {};
+    return registry;
+}
+
+/* Construct the registry when the program starts (rather than when a counter is first
+   updated), so that the totals are still printed by a run which codes nothing */
+inline StatRegistry& startup_stat_registry = stat_registry();
+
+/* The counters of one thread (merged into the registry when the thread exits) */
+struct ThreadStats{
+    //Constructing the registry first ensures that it outlives every ThreadStats
+    ThreadStats(): registry {stat_registry()} {
+
+    }
+    ~ThreadStats(){
+        registry.merge(counters);
+    }
+    StatRegistry& registry;
+    StatCounters counters {};
+};
+
+inline StatCounters& thread_stats(){
+    thread_local ThreadStats stats {};
+    return stats.counters;
+}
+
+inline u64 read_cycle_counter(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/* Adds the cycles between its construction and destruction to a counter */
+class StatCycleTimer{
+public:
+    explicit StatCycleTimer( Stat stat ): stat {stat}, start {read_cycle_counter()} {
+
+    }
+    ~StatCycleTimer(){
+        thread_stats()[(u32)stat] += read_cycle_counter() - start;
+    }
+private:
+    Stat stat;
+    u64 start;
+};
+
+#define ARITH32_STAT_CONCAT_(a, b) a##b
+#define ARITH32_STAT_CONCAT(a, b) ARITH32_STAT_CONCAT_(a, b)
+#define ARITH32_STAT_ADD(stat, amount) (thread_stats()[(u32)Stat::stat] += (amount))
+#define ARITH32_STAT_MAX(stat, value) (thread_stats()[(u32)Stat::stat] = std::max<u64>(thread_stats()[(u32)Stat::stat], (value)))
+#define ARITH32_STAT_CYCLES(stat) StatCycleTimer ARITH32_STAT_CONCAT(stat_cycle_timer_, __LINE__) {Stat::stat}
+
+#else
+
+#define ARITH32_STAT_ADD(stat, amount) ((void)0)
+#define ARITH32_STAT_MAX(stat, value) ((void)0)
+#define ARITH32_STAT_CYCLES(stat) ((void)0)
+
+#endif
+
+
+#endif
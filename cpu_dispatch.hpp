@@ -0,0 +1,130 @@
+/* cpu_dispatch.hpp
+
+   Runtime CPU feature detection and kernel dispatch, so that a single binary
+   (built with plain -O3 for the baseline x86-64 instruction set) can still use
+   the fastest vectorized kernels each machine supports.
+
+   Kernels which have vectorized implementations are compiled once for each
+   instruction set level (using the target attributes defined below, rather than
+   compiler flags) and registered as a KernelVariants table. select_kernel picks
+   the variant for the highest level the CPU supports, and the result is stored
+   in a function pointer the first time the kernel is needed, so the detection
+   only runs once and each call afterward is a single indirect call.
+
+   The levels are cumulative (each includes everything in the levels below it):
+     SSE42     SSE4.2 and POPCNT
+     AVX2      AVX2 and BMI2 (along with the SSE42 level)
+     AVX512    AVX-512 F, BW and VL (along with the AVX2 level)
+
+   The environment variable ARITH32_CPU (one of scalar, sse4.2, avx2 or avx512)
+   caps the level used, e.g. to test the fallback kernels or to match the
+   behaviour of older machines.
+*/
+
+#ifndef CPU_DISPATCH_HPP
+#define CPU_DISPATCH_HPP
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+/* These definitions are more reliable for fixed width types than using "int" and assuming its width */
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define ARITH32_X86_DISPATCH
+#include <immintrin.h>
+/* Target attributes for kernels compiled for each level */
+#define ARITH32_TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+#define ARITH32_TARGET_AVX2 __attribute__((target("sse4.2,popcnt,avx2,bmi,bmi2")))
+#define ARITH32_TARGET_AVX512 __attribute__((target("sse4.2,popcnt,avx2,bmi,bmi2,avx512f,avx512bw,avx512vl")))
+#endif
+
+
+enum class CpuLevel: u32{
+    Scalar = 0,
+    SSE42 = 1,
+    AVX2 = 2,
+    AVX512 = 3,
+};
+
+struct CpuFeatures{
+    bool sse42 {false};
+    bool popcnt {false};
+    bool avx2 {false};
+    bool bmi2 {false};
+    bool avx512 {false};  //AVX-512 F, BW and VL
+};
+
+
+/* Query the CPU's features (without any cap from ARITH32_CPU) */
+inline CpuFeatures detect_cpu_features(){
+    CpuFeatures features {};
+#ifdef ARITH32_X86_DISPATCH
+    __builtin_cpu_init();
+    features.sse42 = __builtin_cpu_supports("sse4.2");
+    features.popcnt = __builtin_cpu_supports("popcnt");
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.bmi2 = __builtin_cpu_supports("bmi2");
+    features.avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl");
+#endif
+    return features;
+}
+
+/* The names accepted by ARITH32_CPU (indexed by CpuLevel) */
+inline constexpr const char* CPU_LEVEL_NAMES[] {"scalar", "sse4.2", "avx2", "avx512"};
+
+/* Returns the highest level supported by the CPU, capped by ARITH32_CPU if it is set
+   (the result is computed on the first call and cached) */
+inline CpuLevel cpu_level(){
+    static const CpuLevel level = []{
+        CpuFeatures features = detect_cpu_features();
+        CpuLevel supported {CpuLevel::Scalar};
+        if (features.sse42 && features.popcnt){
+            supported = CpuLevel::SSE42;
+            if (features.avx2 && features.bmi2){
+                supported = CpuLevel::AVX2;
+                if (features.avx512)
+                    supported = CpuLevel::AVX512;
+            }
+        }
+        if (const char* cap = std::getenv("ARITH32_CPU")){
+            for (u32 i {0}; i < (u32)supported; i++)
+                if (std::strcmp(cap, CPU_LEVEL_NAMES[i]) == 0)
+                    return (CpuLevel)i;
+        }
+        return supported;
+    }();
+    return level;
+}
+
+
+/* The implementations of one kernel (of function pointer type Kernel) for each level.
+   Only the scalar version is required; any other entry may be left null if the
+   kernel has no implementation specific to that level. */
+template<typename Kernel>
+struct KernelVariants{
+    Kernel scalar {nullptr};
+    Kernel sse42 {nullptr};
+    Kernel avx2 {nullptr};
+    Kernel avx512 {nullptr};
+};
+
+/* Return the variant for the highest level (up to the level of this CPU) which is provided */
+template<typename Kernel>
+inline Kernel select_kernel(const KernelVariants<Kernel>& variants){
+    CpuLevel level = cpu_level();
+    if (level >= CpuLevel::AVX512 && variants.avx512)
+        return variants.avx512;
+    if (level >= CpuLevel::AVX2 && variants.avx2)
+        return variants.avx2;
+    if (level >= CpuLevel::SSE42 && variants.sse42)
+        return variants.sse42;
+    return variants.scalar;
+}
+
+
+#endif
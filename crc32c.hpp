@@ -0,0 +1,93 @@
+/* crc32c.hpp
+
+   CRC32C (the Castagnoli polynomial, as used by iSCSI, ext4 and the SSE4.2
+   crc32 instruction) for verifying decoded data against a checksum of the
+   original data stored by the compressor.
+
+   With SSE4.2, the checksum is computed with the crc32 instruction (8 bytes per
+   instruction); otherwise, a slicing-by-8 table implementation is used, which
+   also consumes 8 bytes per step (with 8 independent table lookups). The kernel
+   is chosen at runtime (see cpu_dispatch.hpp).
+*/
+
+#ifndef CRC32C_HPP
+#define CRC32C_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "cpu_dispatch.hpp"
+
+/* These definitions are more reliable for fixed width types than using "int" and assuming its width */
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+
+/* The CRC32C polynomial (bit reversed) */
+inline constexpr u32 CRC32C_POLYNOMIAL = 0x82f63b78;
+
+/* Tables for the slicing-by-8 implementation: CRC32C_TABLES[0][b] is the CRC of the byte b,
+   and CRC32C_TABLES[k][b] is the CRC of b followed by k zero bytes */
+inline constexpr std::array<std::array<u32, 256>, 8> CRC32C_TABLES = []{
+    std::array<std::array<u32, 256>, 8> tables {};
+    for (u32 b {0}; b < 256; b++){
+        u32 crc = b;
+        for (u32 i {0}; i < 8; i++)
+            crc = (crc>>1) ^ ((crc & 1)? CRC32C_POLYNOMIAL : 0);
+        tables[0][b] = crc;
+    }
+    for (u32 k {1}; k < 8; k++)
+        for (u32 b {0}; b < 256; b++)
+            tables[k][b] = (tables[k-1][b]>>8) ^ tables[0][tables[k-1][b] & 0xff];
+    return tables;
+}();
+
+
+/* Kernels: each advances the (non-inverted) CRC state over length bytes of data */
+using Crc32cKernel = u32 (*)(u32 crc, const u8* data, std::size_t length);
+
+inline u32 crc32c_update_scalar(u32 crc, const u8* data, std::size_t length){
+    const auto& t = CRC32C_TABLES;
+    for (; length >= 8; length -= 8, data += 8){
+        u32 low = crc ^ ((u32)data[0] | (u32)data[1]<<8 | (u32)data[2]<<16 | (u32)data[3]<<24);
+        crc = t[7][low & 0xff] ^ t[6][(low>>8) & 0xff] ^ t[5][(low>>16) & 0xff] ^ t[4][low>>24]
+            ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+    }
+    for (; length > 0; length--)
+        crc = (crc>>8) ^ t[0][(crc ^ *data++) & 0xff];
+    return crc;
+}
+
+#ifdef ARITH32_X86_DISPATCH
+ARITH32_TARGET_SSE42
+inline u32 crc32c_update_sse42(u32 crc, const u8* data, std::size_t length){
+    u64 crc64 = crc;
+    for (; length >= 8; length -= 8, data += 8){
+        u64 word;
+        __builtin_memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (u32)crc64;
+    for (; length > 0; length--)
+        crc = _mm_crc32_u8(crc, *data++);
+    return crc;
+}
+#endif
+
+
+/* Returns the CRC32C of length bytes of data. To compute the checksum of data
+   split into several pieces, pass the result for the preceding pieces as crc. */
+inline u32 crc32c(const u8* data, std::size_t length, u32 crc = 0){
+#ifdef ARITH32_X86_DISPATCH
+    static const Crc32cKernel kernel = select_kernel<Crc32cKernel>({
+        .scalar = crc32c_update_scalar, .sse42 = crc32c_update_sse42});
+#else
+    static const Crc32cKernel kernel = crc32c_update_scalar;
+#endif
+    return ~kernel(~crc, data, length);
+}
+
+
+#endif
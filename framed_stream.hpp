@@ -0,0 +1,140 @@
+/* framed_stream.hpp
+
+   Framed stream format: a single encoded stream (see encode_buffer in codec.hpp)
+   preceded by a short header recording the model and coder used and the length
+   of the original data. This is the default output format of arith_compress.
+
+   Since the decoder knows exactly how many bytes to produce, the stream does not
+   need to be terminated by the EOF symbol, so the EOF symbol is removed from the
+   alphabet (leaving just the 256 byte values, with no probability spent on the
+   EOF symbol) and the decoder stops after the last byte instead of relying on the
+   input repeating its last bit. (The output is still grown as the data is decoded,
+   rather than allocated in full from the stored length, so that a corrupt length
+   is caught by the decoder instead of causing a huge allocation.) The header also
+   means that arith_decompress does not need to be told which model and coder were
+   used.
+
+   The header also stores a CRC32C checksum of the original data (see crc32c.hpp),
+   which is computed while the data is encoded and checked while it is decoded, so
+   the decoded output is verified without another pass over it.
+
+   Data which looks incompressible (or which coding would not shrink) is stored
+   as is instead of being coded (see encode_or_store_buffer in codec.hpp), so
+   that it passes through both programs at the speed of a copy.
+
+   Stream format (all integers little endian):
+     Offset   Size   Field
+     0        4      Magic number "A32F"
+     4        1      Format version (FRAMED_STREAM_VERSION)
+     5        1      Model type (a ModelType value from codec.hpp)
+     6        1      Coder type (a CoderType value from codec.hpp)
+     7        1      Flags: bit 0 (FRAMED_FLAG_CHECKSUM) is set if the header includes
+                     a checksum and bit 1 (FRAMED_FLAG_STORED) is set if the data is
+                     stored uncompressed in place of the encoded stream (the model and
+                     coder types are then unused); the other bits are reserved and always 0
+     8        8      Length of the original data in bytes
+     16       4      CRC32C of the original data (only if FRAMED_FLAG_CHECKSUM is set)
+     16 or 20 ...    Encoded stream (starting with the model's header, if any) or stored data
+*/
+
+#ifndef FRAMED_STREAM_HPP
+#define FRAMED_STREAM_HPP
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include "codec.hpp"
+
+
+inline constexpr u8 FRAMED_STREAM_MAGIC[4] {'A', '3', '2', 'F'};
+inline constexpr u8 FRAMED_STREAM_VERSION = 1;
+inline constexpr std::size_t FRAMED_STREAM_HEADER_SIZE = 20;
+inline constexpr std::size_t FRAMED_STREAM_HEADER_SIZE_NO_CHECKSUM = 16;
+inline constexpr u8 FRAMED_FLAG_CHECKSUM = 0x01;
+inline constexpr u8 FRAMED_FLAG_STORED = 0x02;
+
+
+struct FramedStreamHeader{
+    ModelType model;
+    CoderType coder;
+    u64 length;      //Length of the original data
+    bool has_checksum;
+    bool stored;     //True if the data is stored uncompressed
+    u32 checksum;    //CRC32C of the original data (if has_checksum is set)
+    std::size_t size;  //Size of the header in bytes
+};
+
+
+/* Returns true if the buffer starts with the framed stream magic number */
+inline bool is_framed_stream(const u8* data, std::size_t length){
+    return length >= 4 && std::memcmp(data, FRAMED_STREAM_MAGIC, 4) == 0;
+}
+
+
+/* Encode the provided buffer as a framed stream with the given model and coder types
+   (or store it, if it looks incompressible), appending the result to output */
+inline void compress_framed(const u8* data, std::size_t length, ModelType model_type, CoderType coder_type, std::vector<u8>& output, const ModelParameters& parameters = {}){
+    std::size_t start = output.size();
+    output.resize(start + FRAMED_STREAM_HEADER_SIZE);
+    u8* header = output.data() + start;
+    std::memcpy(header, FRAMED_STREAM_MAGIC, 4);
+    header[4] = FRAMED_STREAM_VERSION;
+    header[5] = (u8)model_type;
+    header[6] = (u8)coder_type;
+    header[7] = FRAMED_FLAG_CHECKSUM;
+    store_le(header+8, length, 8);
+    u32 checksum {0};
+    bool stored = encode_or_store_buffer(model_type, coder_type, data, length, output, &checksum, parameters);
+    //(encoding may have reallocated the output)
+    if (stored)
+        output.at(start + 7) |= FRAMED_FLAG_STORED;
+    store_le(output.data() + start + 16, checksum, 4);
+}
+
+
+/* Parse and validate the header of a framed stream.
+   Returns false if the header is malformed or truncated. */
+inline bool read_framed_stream_header(const u8* data, std::size_t length, FramedStreamHeader& header){
+    if (length < FRAMED_STREAM_HEADER_SIZE_NO_CHECKSUM || !is_framed_stream(data, length))
+        return false;
+    if (data[4] != FRAMED_STREAM_VERSION || !is_valid_model_type(data[5]) || !is_valid_coder_type(data[6]))
+        return false;
+    if ((data[7] & ~(FRAMED_FLAG_CHECKSUM | FRAMED_FLAG_STORED)) != 0)
+        return false;
+    header.model = (ModelType)data[5];
+    header.coder = (CoderType)data[6];
+    header.length = load_le(data+8, 8);
+    header.has_checksum = data[7] & FRAMED_FLAG_CHECKSUM;
+    header.stored = data[7] & FRAMED_FLAG_STORED;
+    header.size = header.has_checksum? FRAMED_STREAM_HEADER_SIZE : FRAMED_STREAM_HEADER_SIZE_NO_CHECKSUM;
+    if (length < header.size)
+        return false;
+    header.checksum = header.has_checksum? load_le(data+16, 4) : 0;
+    return coder_supports_model(header.coder, header.model);
+}
+
+
+/* Decode a framed stream and append the decoded data to output.
+   Returns false if the stream is malformed, fails to decode or does not match its checksum. */
+inline bool decompress_framed(const u8* data, std::size_t length, std::vector<u8>& output, const ModelParameters& parameters = {}){
+    FramedStreamHeader header {};
+    if (!read_framed_stream_header(data, length, header))
+        return false;
+    u32 checksum {0};
+    u32* computed_checksum = header.has_checksum? &checksum : nullptr;
+    if (header.stored){
+        //(A stored stream is checked against its length before anything is allocated)
+        if (length - header.size != header.length)
+            return false;
+        std::size_t start = output.size();
+        output.resize(start + header.length);
+        copy_stored_buffer(data + header.size, length - header.size, output.data() + start, header.length, computed_checksum);
+    }else if (!decode_buffer_append(header.model, header.coder, data + header.size, length - header.size, output, header.length, StreamEnd::Length, computed_checksum, parameters)){
+        return false;
+    }
+    return !header.has_checksum || checksum == header.checksum;
+}
+
+
+#endif
@@ -0,0 +1,255 @@
+/* hashed_context_model.hpp
+
+   Adaptive order-2 and order-3 context models (see static_model.hpp for the model
+   interface), which condition the probability of each symbol on the previous 2 or
+   3 bytes. There are far too many such contexts to give each one a full frequency
+   table (as Order1Model does), so each context is hashed into a fixed-size table
+   of buckets, one cache line each, and a bucket holds just the context's most
+   recently seen symbols (up to BUCKET_SLOTS of them) with a small adaptive count
+   for each. A context which hashes to a bucket owned by another context (according
+   to a 16 bit check value) takes the bucket over, and starts again from nothing.
+
+   Each symbol is coded either with the counts of the current context's bucket, if
+   the symbol is in it, or else with an order-1 model (much as PPM escapes to a
+   shorter context). The code space of the model is split in two: the order-1
+   model's frequencies come first, and the bucket's counts follow them, in the
+   order of the bucket's slots. (An order-1 frequency of a symbol which is in the
+   bucket is unused, which wastes a little code space, but a decoder only has to
+   compare the scaled symbol with the order-1 total to know which of the two to
+   search, and the bucket is searched with a short scan of its counts.) The order-1
+   model is only updated with the symbols it codes, so that it learns the symbols
+   which are new to their longer contexts ("update exclusion" in PPM).
+
+   Each symbol coded with a bucket has its count increased by BUCKET_INCREMENT
+   (and a new symbol replaces the symbol with the lowest count if the bucket is
+   full), and the counts of a bucket are halved (dropping the symbols whose counts
+   reach zero) whenever their total exceeds BUCKET_MAX_TOTAL. The total of the
+   model never exceeds 2^16, so it can be used with the range coder.
+
+   The size of the table is set by a memory budget (rounded down to a power of two
+   between 2^MIN_TABLE_BITS and 2^MAX_TABLE_BITS bytes), which is stored in the
+   model's header (see write_header/read_header), so the decoder allocates the
+   same table as the encoder. The table is allocated with LargeBuffer (so pages
+   of the table which are never touched cost nothing), optionally with huge pages.
+   Coding each symbol touches just the bucket and two cache lines of the order-1
+   table, so the model still codes one symbol at a time (and can be used for
+   streaming) like the other adaptive models.
+*/
+
+#ifndef HASHED_CONTEXT_MODEL_HPP
+#define HASHED_CONTEXT_MODEL_HPP
+
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include "coder_stats.hpp"
+#include "order1_model.hpp"
+#include "large_buffer.hpp"
+
+/* These definitions are more reliable for fixed width types than using "int" and assuming its width */
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+
+template<u32 Order>
+class HashedContextModel{
+    static_assert(Order == 2 || Order == 3, "HashedContextModel supports orders 2 and 3");
+public:
+    static constexpr u32 EOF_SYMBOL = Order1Model::EOF_SYMBOL;
+
+    /* Number of symbols each bucket can hold */
+    static constexpr u32 BUCKET_SLOTS = 20;
+
+    /* Amount added to a symbol's count each time it is coded in the bucket's context */
+    static constexpr u32 BUCKET_INCREMENT = 2048;
+
+    /* Limit on the total of each context of the order-1 model */
+    static constexpr u32 ORDER1_MAX_TOTAL = 2048;
+
+    /* A bucket's counts are halved whenever their total exceeds this value
+       (which keeps the total of the model within 2^16) */
+    static constexpr u32 BUCKET_MAX_TOTAL = std::min<u32>((1<<16) - ORDER1_MAX_TOTAL, (1<<16) - 1 - BUCKET_INCREMENT);
+
+    /* Range of table sizes (as powers of two, in bytes) */
+    static constexpr u32 MIN_TABLE_BITS = 20;
+    static constexpr u32 MAX_TABLE_BITS = 30;
+
+    /* Default memory budget for the table */
+    static constexpr u64 DEFAULT_MEMORY_BUDGET = 1<<24;
+
+    /* Constructor (with the memory budget of the table in bytes) */
+    explicit HashedContextModel( u64 memory_budget = DEFAULT_MEMORY_BUDGET, bool huge_pages = false ):
+        order1 {ORDER1_MAX_TOTAL}, huge_pages {huge_pages} {
+        u32 bits {MIN_TABLE_BITS};
+        while(bits < MAX_TABLE_BITS && (memory_budget>>(bits + 1)) != 0)
+            bits++;
+        allocate_table(bits);
+    }
+
+    u64 total() const{
+        return order1.total() + bucket->total;
+    }
+
+    void get_range(u32 symbol, u64& low, u64& high) const{
+        //Find the symbol's count in the bucket and the counts of the slots before it
+        const Bucket& b = *bucket;
+        u32 count {0};
+        u32 below {0};
+        for (u32 i {0}; i < BUCKET_SLOTS; i++){
+            u32 match = -(u32)(b.counts[i] != 0 && b.symbols[i] == symbol);
+            count |= b.counts[i] & match;
+            below += b.counts[i] & ~(-(u32)(count != 0));
+        }
+        if (count == 0){
+            order1.get_range(symbol, low, high);
+            return;
+        }
+        low = order1.total() + below;
+        high = low + count;
+    }
+
+    u32 find_symbol(u64 scaled_symbol, u64& low, u64& high) const{
+        u64 order1_total = order1.total();
+        if (scaled_symbol < order1_total)
+            return order1.find_symbol(scaled_symbol, low, high);
+        //Walk through the bucket's slots (skipping the unused slots, which have no counts)
+        const Bucket& b = *bucket;
+        u32 target = scaled_symbol - order1_total;
+        u32 cumulative {0};
+        u32 slot {0};
+        while(slot < BUCKET_SLOTS - 1 && cumulative + b.counts[slot] <= target)
+            cumulative += b.counts[slot++];
+        ARITH32_STAT_ADD(SearchCalls, 1);
+        ARITH32_STAT_ADD(SearchIterations, 1 + slot);
+        low = order1_total + cumulative;
+        high = low + b.counts[slot];
+        return b.symbols[slot];
+    }
+
+    void update(u32 symbol){
+        //The order-1 model only counts the symbols which were not in the bucket
+        //(including the EOF symbol, which never is)
+        if (symbol != EOF_SYMBOL && update_bucket(*bucket, symbol))
+            order1.skip(symbol);
+        else
+            order1.update(symbol);
+        history = ((history<<8) | (symbol & 0xff)) & HISTORY_MASK;
+        find_bucket();
+    }
+
+    void get_byte_frequencies(std::array<u32, 256>& byte_frequencies) const{
+        //(The order-1 frequencies of the symbols in the bucket are unused)
+        order1.get_byte_frequencies(byte_frequencies);
+        const Bucket& b = *bucket;
+        for (u32 i {0}; i < BUCKET_SLOTS; i++)
+            if (b.counts[i] != 0)
+                byte_frequencies[b.symbols[i]] = b.counts[i];
+    }
+
+    void remove_eof_symbol(){
+        order1.remove_eof_symbol();
+    }
+
+    /* Write the size of the table to the stream (as a single byte giving its base 2 logarithm) */
+    template<typename OutStream>
+    void write_header(OutStream& stream) const{
+        stream.push_byte(table_bits);
+    }
+
+    /* Read the size of the table from the stream (reallocating the table if necessary) */
+    template<typename InStream>
+    void read_header(InStream& stream){
+        u32 bits = std::clamp<u32>(stream.read_byte(), MIN_TABLE_BITS, MAX_TABLE_BITS);
+        if (bits != table_bits)
+            allocate_table(bits);
+    }
+
+    /* Size of the table in bytes */
+    u64 table_size() const{
+        return (u64)1<<table_bits;
+    }
+
+    /* Returns true if the table is backed by huge pages (see LargeBuffer) */
+    bool uses_huge_pages() const{
+        return memory.uses_huge_pages();
+    }
+
+private:
+    static constexpr u32 HISTORY_MASK = (1u<<(8*Order)) - 1;
+    static constexpr u64 HASH_MULTIPLIER = 0x9e3779b97f4a7c15;
+
+    struct alignas(64) Bucket{
+        u16 check;   //Identifies the context which owns the bucket
+        u16 total;   //Total of the counts
+        std::array<u8, BUCKET_SLOTS> symbols;
+        std::array<u16, BUCKET_SLOTS> counts;   //Zero for an unused slot
+    };
+    static_assert(sizeof(Bucket) == 64);
+
+    /* (Re)allocate an empty table of 2^bits bytes */
+    void allocate_table(u32 bits){
+        memory = LargeBuffer {(std::size_t)1<<bits, huge_pages};
+        buckets = (Bucket*)memory.data();
+        table_bits = bits;
+        find_bucket();
+    }
+
+    /* Find the bucket of the current context (taking it over if another context owns it) */
+    void find_bucket(){
+        //The index is taken from the top bits of the hash and the check from the
+        //bits below them (the low bits of a multiplicative hash are poorly mixed)
+        u64 hash = (history + 1)*HASH_MULTIPLIER;
+        bucket = &buckets[hash>>(64 - table_bits + 6)];
+        u16 check = (u16)(hash>>24);
+        if (bucket->check != check){
+            std::memset((void*)bucket, 0, sizeof(Bucket));
+            bucket->check = check;
+        }
+    }
+
+    /* Count the symbol in the bucket. Returns true if the symbol was already in the bucket. */
+    static bool update_bucket(Bucket& b, u32 symbol){
+        //Find the symbol's slot, or else replace the symbol with the lowest count
+        //(the loops are written without branches, which are hard to predict here)
+        u32 slot {BUCKET_SLOTS};
+        for (u32 i {0}; i < BUCKET_SLOTS; i++)
+            slot = (b.counts[i] != 0 && b.symbols[i] == symbol)? i : slot;
+        bool found = slot != BUCKET_SLOTS;
+        if (!found){
+            slot = 0;
+            u32 lowest = b.counts[0];
+            for (u32 i {1}; i < BUCKET_SLOTS; i++){
+                slot = (b.counts[i] < lowest)? i : slot;
+                lowest = std::min<u32>(lowest, b.counts[i]);
+            }
+            b.total -= b.counts[slot];
+            b.symbols[slot] = symbol;
+            b.counts[slot] = 0;
+        }
+        b.counts[slot] += BUCKET_INCREMENT;
+        b.total += BUCKET_INCREMENT;
+        if (b.total > BUCKET_MAX_TOTAL){
+            b.total = 0;
+            for (auto& count: b.counts){
+                count /= 2;
+                b.total += count;
+            }
+        }
+        return found;
+    }
+
+    Order1Model order1;
+    bool huge_pages;
+    LargeBuffer memory {};
+    Bucket* buckets {nullptr};
+    Bucket* bucket {nullptr};   //The bucket of the current context
+    u32 table_bits {0};
+    u32 history {0};   //The previous Order bytes
+};
+
+
+#endif
@@ -0,0 +1,101 @@
+/* histogram.hpp
+
+   Byte histogram of a buffer (used to build static models from the data itself).
+*/
+
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+/* These definitions are more reliable for fixed width types than using "int" and assuming its width */
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+
+using ByteHistogram = std::array<u64, 256>;
+
+/* Count the occurrences of each byte value in the provided buffer. */
+inline ByteHistogram byte_histogram(const u8* data, std::size_t length){
+    //Incrementing a single table creates a chain of store-to-load dependencies
+    //whenever the same byte value appears several times in a row (which is very
+    //common), so the bytes are spread over four independent sub-histograms
+    //which are summed at the end. Each iteration of the main loop loads
+    //8 bytes at once and extracts them with shifts.
+    //The sub-histograms use 32 bit counters (to halve their cache footprint),
+    //so they are added to the result at least every 2^31 bytes.
+    const std::size_t CHUNK_SIZE = (std::size_t)1<<31;
+    ByteHistogram result {};
+    std::array<std::array<u32, 256>, 4> counts;
+    while(length > 0){
+        std::size_t chunk_length = std::min(length, CHUNK_SIZE);
+        for (auto& sub_histogram: counts)
+            sub_histogram.fill(0);
+        std::size_t i {0};
+        for(; i + 8 <= chunk_length; i += 8){
+            u64 word {0};
+            for (u32 j {0}; j < 8; j++)
+                word |= (u64)data[i+j]<<(8*j);
+            counts[0][(u8)(word)]++;
+            counts[1][(u8)(word>>8)]++;
+            counts[2][(u8)(word>>16)]++;
+            counts[3][(u8)(word>>24)]++;
+            counts[0][(u8)(word>>32)]++;
+            counts[1][(u8)(word>>40)]++;
+            counts[2][(u8)(word>>48)]++;
+            counts[3][(u8)(word>>56)]++;
+        }
+        for(; i < chunk_length; i++)
+            counts[0][data[i]]++;
+        for (u32 symbol {0}; symbol < 256; symbol++)
+            result[symbol] += (u64)counts[0][symbol] + counts[1][symbol] + counts[2][symbol] + counts[3][symbol];
+        data += chunk_length;
+        length -= chunk_length;
+    }
+    return result;
+}
+
+
+/* Histogram of a sample of the provided buffer: if the buffer is longer than sample_size
+   bytes, only NUM_HISTOGRAM_SAMPLES evenly spaced runs of bytes (sample_size bytes in total)
+   are counted, so that the cost does not depend on the size of the buffer. */
+inline constexpr std::size_t NUM_HISTOGRAM_SAMPLES = 16;
+
+inline ByteHistogram sampled_byte_histogram(const u8* data, std::size_t length, std::size_t sample_size = 1<<16){
+    if (length <= sample_size)
+        return byte_histogram(data, length);
+    std::size_t run_length = sample_size/NUM_HISTOGRAM_SAMPLES;
+    std::size_t spacing = (length - run_length)/(NUM_HISTOGRAM_SAMPLES - 1);
+    ByteHistogram result {};
+    for (std::size_t i {0}; i < NUM_HISTOGRAM_SAMPLES; i++){
+        ByteHistogram run = byte_histogram(data + i*spacing, run_length);
+        for (u32 symbol {0}; symbol < 256; symbol++)
+            result[symbol] += run[symbol];
+    }
+    return result;
+}
+
+
+/* Order-0 (Shannon) entropy of the bytes counted by a histogram, in bits per byte */
+inline double histogram_entropy(const ByteHistogram& histogram){
+    u64 total {0};
+    for (u64 count: histogram)
+        total += count;
+    double entropy {0};
+    for (u64 count: histogram){
+        if (count == 0)
+            continue;
+        double p = (double)count/total;
+        entropy -= p*std::log2(p);
+    }
+    return entropy;
+}
+
+
+#endif
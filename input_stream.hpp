@@ -14,7 +14,12 @@
 #define INPUT_STREAM_HPP
 
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
 #include <cstdint>
+#include "coder_stats.hpp"
 
 /* These definitions are more reliable for fixed width types than using "int" and assuming its width */
 using u8 = std::uint8_t;
@@ -50,6 +55,12 @@ public:
         return read_bits(8) | (read_bits(8)<<8);
     }
 
+    /* Read count bytes from the stream into destination */
+    void read_bytes(u8* destination, std::size_t count){
+        for (std::size_t i {0}; i < count; i++)
+            destination[i] = read_byte();
+    }
+
     /* Read the lowest order num_bits bits from the stream into a u32,
        with the least significant bit read first.
     */
@@ -87,6 +98,7 @@ private:
             numbits = 0;
             return;
         }
+        ARITH32_STAT_ADD(BytesRead, 1);
         bitvec = (u8)c;
         numbits = 0;
     }
@@ -98,4 +110,200 @@ private:
 };
 
 
+
+/* Buffered variant of InputBitStream (with an identical bit ordering).
+
+   The input is pulled from the std::istream in large chunks (BUFFER_SIZE bytes
+   per read call) and the next unread bits are kept in a 64 bit window, so that
+   peek_bits/consume_bits (and therefore read_bits) take O(1) time instead of
+   one virtual stream call per byte and one loop iteration per bit.
+
+   Like InputBitStream, once the end of the input is reached this will produce
+   an infinite number of copies of the last bit in the file.
+
+   The stream counts the copies of the last bit it has produced, so that a decoder
+   reading far past the end of its input (which only happens for a corrupt stream)
+   can be detected (see bytes_past_end).
+
+   The stream can also be constructed around an existing block of memory, in
+   which case bits are read directly from it (without any copying), and whole
+   runs of bytes can be taken from it in place (see read_in_place).
+*/
+class BufferedInputBitStream{
+public:
+    /* Size (in bytes) of the internal input buffer */
+    static constexpr std::size_t BUFFER_SIZE = 1<<16;
+
+    /* Constructor */
+    BufferedInputBitStream( std::istream& input_stream ): bitbuf {0}, numbits {0}, buffer(BUFFER_SIZE), next {nullptr}, end {nullptr}, infile {&input_stream}, done {false}, last_byte {0}, bits_past_end {0} {
+
+    }
+
+    /* Constructor (read from the provided block of memory, which must outlive the stream) */
+    BufferedInputBitStream( const u8* data, std::size_t size ): bitbuf {0}, numbits {0}, buffer {}, next {data}, end {data + size}, infile {nullptr}, done {true}, last_byte {0}, bits_past_end {0} {
+        if (size > 0)
+            last_byte = data[size-1];
+    }
+
+    /* Read an entire byte from the stream, with the least significant bit read first */
+    u8 read_byte(){
+        return read_bits(8);
+    }
+
+    /* Read a 32 bit unsigned integer value (LSB first) */
+    u32 read_u32(){
+        return read_bits(32);
+    }
+
+    /* Read a 16 bit unsigned short value (LSB first) */
+    u16 read_u16(){
+        return read_bits(16);
+    }
+
+    /* Read count bytes from the stream into destination. If the stream is at a
+       byte boundary, the bytes are copied directly from the input buffer. */
+    void read_bytes(u8* destination, std::size_t count){
+        if (numbits%8 == 0){
+            //Use up the whole bytes left in the window first
+            while(count > 0 && numbits > 0){
+                *destination++ = read_byte();
+                count--;
+            }
+            //If the window is now empty, it might still hold part of the byte at
+            //next (see refill), which will be copied below instead.
+            if (count > 0)
+                bitbuf = 0;
+            while(count > 0 && (next != end || input_chunk())){
+                std::size_t length = std::min<std::size_t>(count, end - next);
+                std::memcpy(destination, next, length);
+                ARITH32_STAT_ADD(BytesRead, length);
+                next += length;
+                destination += length;
+                count -= length;
+            }
+        }
+        //Any remaining bytes are unaligned (or past the end of the input)
+        for (std::size_t i {0}; i < count; i++)
+            destination[i] = read_byte();
+    }
+
+    /* Return the next num_bits bits (at most 32) of the stream without consuming them,
+       with the first bit of the stream stored in the LSB of the result.
+    */
+    u32 peek_bits(u32 num_bits){
+        if (numbits < num_bits)
+            refill();
+        return (u32)(bitbuf & (((u64)1<<num_bits) - 1));
+    }
+
+    /* Discard the next num_bits bits of the stream. The bits must have been
+       made available by a previous call to peek_bits. */
+    void consume_bits(u32 num_bits){
+        bitbuf >>= num_bits;
+        numbits -= num_bits;
+    }
+
+    /* Read the lowest order num_bits bits (at most 32) from the stream into a u32,
+       with the least significant bit read first.
+    */
+    u32 read_bits(u32 num_bits){
+        u32 result = peek_bits(num_bits);
+        consume_bits(num_bits);
+        return result;
+    }
+
+    /* Read a single bit b (stored as the LSB of an unsigned int)
+       from the stream */
+    u32 read_bit(){
+        return read_bits(1);
+    }
+
+    /* If the stream was constructed around a block of memory, is at a byte boundary and
+       has at least count bytes left, consume the next count bytes and return a pointer to
+       them within that block (without copying them). Otherwise, return nullptr (and
+       consume nothing). */
+    const u8* read_in_place(std::size_t count){
+        if (infile || numbits%8 != 0 || bits_past_end > 0)
+            return nullptr;
+        //Every byte in the window was loaded from the bytes just before next
+        const u8* position = next - numbits/8;
+        if ((std::size_t)(end - position) < count)
+            return nullptr;
+        ARITH32_STAT_ADD(BytesRead, (position + count) - next);
+        bitbuf = 0;
+        numbits = 0;
+        next = position + count;
+        return position;
+    }
+
+    /* Returns the number of bytes (rounded down) read past the end of the input so far
+       (not counting the copies of the last bit which are still in the window unread) */
+    u64 bytes_past_end() const{
+        return (bits_past_end - std::min<u64>(bits_past_end, numbits))/8;
+    }
+
+    /* Flush the currently stored bits */
+    void flush_to_byte(){
+        //Every byte enters the window whole, so the bits left over from the 
+        //current byte are the lowest (numbits mod 8) bits in the window.
+        consume_bits(numbits&7);
+    }
+private:
+    /* Top up the bit window to at least 56 valid bits */
+    void refill(){
+        //Fast path: with at least 8 bytes left in the buffer, add as many whole bytes
+        //as will fit using a single 64 bit load. Any partial byte shifted in
+        //above the valid bits is identical to what the next refill will place there.
+        if (end - next >= 8){
+            u64 word {0};
+            for(u32 i {0}; i < 8; i++)
+                word |= (u64)next[i]<<(8*i);
+            bitbuf |= word<<numbits;
+            ARITH32_STAT_ADD(BytesRead, (63 - numbits)>>3);
+            next += (63 - numbits)>>3;
+            numbits |= 56;
+            return;
+        }
+        while(numbits <= 56){
+            if (next == end && !input_chunk()){
+                //Past the end of the input, fill the window with copies of the
+                //last bit of the file (the MSB of the last byte read).
+                if (last_byte>>7)
+                    bitbuf |= ~(u64)0<<numbits;
+                bits_past_end += 64 - numbits;
+                numbits = 64;
+                return;
+            }
+            ARITH32_STAT_ADD(BytesRead, 1);
+            bitbuf |= (u64)(*next++)<<numbits;
+            numbits += 8;
+        }
+    }
+    bool input_chunk(){
+        if (done)
+            return false;
+        ARITH32_STAT_CYCLES(IoCycles);
+        infile->read((char*)buffer.data(), BUFFER_SIZE);
+        std::size_t count = infile->gcount();
+        if (count == 0){
+            done = true;
+            return false;
+        }
+        next = buffer.data();
+        end = next + count;
+        last_byte = end[-1];
+        return true;
+    }
+    u64 bitbuf;
+    u32 numbits;
+    std::vector<u8> buffer;
+    const u8* next;
+    const u8* end;
+    std::istream* infile;
+    bool done;
+    u8 last_byte;
+    u64 bits_past_end;   //The number of copies of the last bit added to the window
+};
+
+
 #endif 
\ No newline at end of file
@@ -0,0 +1,230 @@
+/* interleaved_arith_coder.hpp
+
+   Interleaved arithmetic coder: symbols are dealt round-robin to NumStreams
+   independent ArithEncoder/ArithDecoder instances, each writing its own
+   sub-stream. Symbol i is coded by coder i mod NumStreams, so consecutive
+   symbols belong to separate dependency chains, and a single core can overlap
+   the multiplications, divisions and renormalization of the coders.
+
+   Two streams (arith-x2 in codec.hpp) are as many as pay off: by then the
+   coders are limited by the number of instructions (and, for a model whose
+   total is not a power of two, divisions) per symbol rather than by the
+   length of each chain, so a third or fourth stream only adds overhead.
+
+   All of the coders share the one model (which is updated after every symbol,
+   in the original symbol order), so any model can be used, although the chains
+   only become fully independent with a static model.
+
+   Each coder ends its sub-stream with the EOF symbol as usual; the coder that
+   would have coded the symbol after the last one is finished first, so that the
+   decoder (which stops at the first EOF symbol it reads) sees the same model
+   state as the encoder did. The sub-streams are buffered in memory by the encoder
+   (until finish()). The decoder reads them in place when its input is a block of
+   memory, and otherwise copies them all out of the input up front.
+
+   Stream format (all LSB first):
+     64 bits * NumStreams   Length of each sub-stream in bytes
+     ...                    The sub-streams, in order
+*/
+
+#ifndef INTERLEAVED_ARITH_CODER_HPP
+#define INTERLEAVED_ARITH_CODER_HPP
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "input_stream.hpp"
+#include "output_stream.hpp"
+#include "arith_coder.hpp"
+
+
+
+template<typename Model, typename OutStream, u32 NumStreams>
+class InterleavedArithEncoder{
+public:
+    using SubEncoder = ArithEncoder<Model, WordOutputBitStream>;
+    using State = typename SubEncoder::State;
+
+    /* Constructor */
+    InterleavedArithEncoder( Model& model, OutStream& stream ): model {model}, stream {stream}, next_stream {0} {
+        for (u32 i {0}; i < NumStreams; i++){
+            substreams.at(i) = std::make_unique<WordOutputBitStream>(buffers.at(i));
+            encoders.at(i) = std::make_unique<SubEncoder>(model, *substreams.at(i));
+        }
+    }
+
+    /* Encode every byte of the provided buffer */
+    void encode(const u8* data, std::size_t length){
+        std::size_t i {0};
+        //Encode single symbols until the next symbol goes to the first coder
+        for (; i < length && next_stream != 0; i++)
+            encode_symbol(data[i]);
+        //Then whole rounds, with one symbol for each coder (holding the states of
+        //the coders in local variables, so that they are independent of each other
+        //and of the stores to the sub-streams)
+        std::array<State, NumStreams> states {};
+        for (u32 j {0}; j < NumStreams; j++)
+            states[j] = encoders[j]->get_state();
+        for (; i + NumStreams <= length; i += NumStreams)
+            for (u32 j {0}; j < NumStreams; j++)
+                SubEncoder::encode_symbol(model, *substreams[j], states[j], data[i+j]);
+        for (u32 j {0}; j < NumStreams; j++)
+            encoders[j]->get_state() = states[j];
+        for (; i < length; i++)
+            encode_symbol(data[i]);
+    }
+
+    /* Encode a single symbol */
+    void encode_symbol(u32 symbol){
+        encoders[next_stream]->encode_symbol(symbol);
+        next_stream = (next_stream + 1)%NumStreams;
+    }
+
+    /* Encode the EOF symbol into every sub-stream and write the sub-streams to the stream
+       (no further symbols may be encoded afterward) */
+    void finish(){
+        for (u32 i {0}; i < NumStreams; i++){
+            u32 j = (next_stream + i)%NumStreams;
+            encoders.at(j)->finish();
+            substreams.at(j)->flush();
+        }
+        write_substreams();
+    }
+
+    /* Flush every sub-stream without encoding the EOF symbol, for streams whose length
+       is stored separately, and write them to the stream (no further symbols may be
+       encoded afterward) */
+    void finish_without_eof(){
+        for (u32 i {0}; i < NumStreams; i++){
+            encoders.at(i)->finish_without_eof();
+            substreams.at(i)->flush();
+        }
+        write_substreams();
+    }
+
+private:
+    void write_substreams(){
+        for (const auto& buffer: buffers){
+            stream.push_u32((u32)buffer.size());
+            stream.push_u32((u32)((u64)buffer.size()>>32));
+        }
+        for (const auto& buffer: buffers)
+            stream.write_bytes(buffer.data(), buffer.size());
+    }
+
+    Model& model;
+    OutStream& stream;
+    std::array<std::vector<u8>, NumStreams> buffers {};
+    std::array<std::unique_ptr<WordOutputBitStream>, NumStreams> substreams {};
+    std::array<std::unique_ptr<SubEncoder>, NumStreams> encoders {};
+    u32 next_stream;
+};
+
+
+
+template<typename Model, typename InStream, u32 NumStreams>
+class InterleavedArithDecoder{
+public:
+    using SubDecoder = ArithDecoder<Model, BufferedInputBitStream>;
+
+    /* The sub-streams of a stream which is not in memory are copied out of it in
+       chunks of this size */
+    static constexpr std::size_t COPY_CHUNK_SIZE = 1<<16;
+
+    /* Constructor (reads every sub-stream from the stream). If the sub-streams are
+       longer than the rest of the stream (which only happens for a corrupt stream), the
+       decoder starts out finished, so nothing is decoded. */
+    InterleavedArithDecoder( Model& model, InStream& stream ): next_stream {0}, done {false} {
+        std::array<u64, NumStreams> lengths {};
+        u64 total_length {0};
+        for (u64& length: lengths){
+            length = stream.read_u32();
+            length |= (u64)stream.read_u32()<<32;
+            //(A total which overflows can only come from a corrupt stream)
+            done = done || length > ~(u64)0 - total_length;
+            total_length += length;
+        }
+        //(read_in_place fails if the lengths add up to more than the bytes left)
+        const u8* data = done? nullptr : stream.read_in_place(total_length);
+        if (!data && !done){
+            //Copy a chunk at a time, so that corrupt lengths can't allocate much more than the input itself
+            for (u64 copied {0}; copied < total_length && !done; copied += COPY_CHUNK_SIZE){
+                std::size_t chunk_length = std::min<u64>(COPY_CHUNK_SIZE, total_length - copied);
+                buffer.resize(copied + chunk_length);
+                stream.read_bytes(buffer.data() + copied, chunk_length);
+                done = stream.bytes_past_end() > 0;
+            }
+            data = buffer.data();
+        }
+        if (done)
+            lengths.fill(0);
+        for (u32 i {0}; i < NumStreams; i++){
+            substreams.at(i) = std::make_unique<BufferedInputBitStream>(data, lengths.at(i));
+            decoders.at(i) = std::make_unique<SubDecoder>(model, *substreams.at(i));
+            data += lengths.at(i);
+        }
+    }
+
+    /* Decode symbols into the provided buffer until either the buffer is full or
+       the EOF symbol is reached. Returns the number of bytes written. */
+    std::size_t decode(u8* output, std::size_t capacity){
+        std::size_t length {0};
+        while(length < capacity && !done){
+            //Decode whole rounds (one symbol from each coder) when possible
+            if (next_stream == 0 && capacity - length >= NumStreams){
+                for (u32 j {0}; j < NumStreams; j++){
+                    u32 symbol = decoders[j]->decode_symbol();
+                    if (symbol == Model::EOF_SYMBOL){
+                        done = true;
+                        next_stream = j;
+                        return length;
+                    }
+                    output[length++] = symbol;
+                }
+                continue;
+            }
+            u32 symbol = decode_symbol();
+            if (symbol == Model::EOF_SYMBOL)
+                break;
+            output[length++] = symbol;
+        }
+        return length;
+    }
+
+    /* Returns true once the EOF symbol has been decoded */
+    bool finished() const{
+        return done;
+    }
+
+    /* Decode a single symbol */
+    u32 decode_symbol(){
+        u32 symbol = decoders[next_stream]->decode_symbol();
+        if (symbol == Model::EOF_SYMBOL)
+            done = true;
+        else
+            next_stream = (next_stream + 1)%NumStreams;
+        return symbol;
+    }
+
+    /* Returns the largest number of bytes read past the end of any sub-stream (see
+       BufferedInputBitStream::bytes_past_end) */
+    u64 bytes_past_end() const{
+        u64 result {0};
+        for (const auto& substream: substreams)
+            result = std::max(result, substream->bytes_past_end());
+        return result;
+    }
+
+private:
+    std::vector<u8> buffer {};   //The sub-streams, if they had to be copied out of the stream
+    std::array<std::unique_ptr<BufferedInputBitStream>, NumStreams> substreams {};
+    std::array<std::unique_ptr<SubDecoder>, NumStreams> decoders {};
+    u32 next_stream;
+    bool done;
+};
+
+
+#endif
@@ -0,0 +1,130 @@
+/* large_buffer.hpp
+
+   Large zero-initialized buffers (such as the tables of the hashed context models),
+   allocated directly with mmap where it is available. The pages of a mapped buffer
+   are only zeroed and committed when they are first touched, so a large table which
+   is only partly used costs nothing up front.
+
+   A buffer can also be backed by huge pages (2MB rather than 4KB pages on x86-64),
+   which cuts the TLB misses of random accesses to a large table. Huge pages are
+   requested with MAP_HUGETLB first (which requires huge pages to be reserved, e.g.
+   through /proc/sys/vm/nr_hugepages), and then with madvise(MADV_HUGEPAGE) (which
+   asks for transparent huge pages, if they are enabled). If neither is available,
+   the buffer silently uses normal pages.
+*/
+
+#ifndef LARGE_BUFFER_HPP
+#define LARGE_BUFFER_HPP
+
+#include <new>
+#include <utility>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define ARITH32_HAVE_MMAP
+#endif
+
+/* These definitions are more reliable for fixed width types than using "int" and assuming its width */
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+
+class LargeBuffer{
+public:
+    /* Size of a huge page (the buffer is rounded up to a multiple of this to use MAP_HUGETLB) */
+    static constexpr std::size_t HUGE_PAGE_SIZE = 1<<21;
+
+    /* Constructor (an empty buffer) */
+    LargeBuffer(){
+
+    }
+
+    /* Constructor (allocate size bytes, aligned to at least a cache line, all initially zero).
+       Throws std::bad_alloc if the memory cannot be allocated. */
+    explicit LargeBuffer( std::size_t size, bool huge_pages = false ): length {size} {
+#ifdef ARITH32_HAVE_MMAP
+#ifdef MAP_HUGETLB
+        if (huge_pages && size >= HUGE_PAGE_SIZE){
+            mapped_length = (size + HUGE_PAGE_SIZE - 1)/HUGE_PAGE_SIZE*HUGE_PAGE_SIZE;
+            memory = mmap(nullptr, mapped_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (memory != MAP_FAILED){
+                huge = true;
+                return;
+            }
+        }
+#endif
+        mapped_length = size;
+        memory = mmap(nullptr, mapped_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            throw std::bad_alloc {};
+#ifdef MADV_HUGEPAGE
+        if (huge_pages)
+            huge = madvise(memory, mapped_length, MADV_HUGEPAGE) == 0;
+#endif
+#else
+        //Without mmap, over-allocate so that the start can be aligned to a cache line
+        (void)huge_pages;
+        memory = std::calloc(size + 64, 1);
+        if (!memory)
+            throw std::bad_alloc {};
+#endif
+    }
+
+    LargeBuffer( const LargeBuffer& ) = delete;
+    LargeBuffer& operator=( const LargeBuffer& ) = delete;
+
+    LargeBuffer( LargeBuffer&& other ) noexcept:
+        memory {std::exchange(other.memory, nullptr)}, length {other.length}, mapped_length {other.mapped_length}, huge {other.huge} {
+
+    }
+
+    LargeBuffer& operator=( LargeBuffer&& other ) noexcept{
+        std::swap(memory, other.memory);
+        std::swap(length, other.length);
+        std::swap(mapped_length, other.mapped_length);
+        std::swap(huge, other.huge);
+        return *this;
+    }
+
+    /* Destructor */
+    ~LargeBuffer(){
+        if (!memory)
+            return;
+#ifdef ARITH32_HAVE_MMAP
+        munmap(memory, mapped_length);
+#else
+        std::free(memory);
+#endif
+    }
+
+    u8* data() const{
+#ifdef ARITH32_HAVE_MMAP
+        return (u8*)memory;
+#else
+        return (u8*)(((std::uintptr_t)memory + 63) & ~(std::uintptr_t)63);
+#endif
+    }
+
+    std::size_t size() const{
+        return length;
+    }
+
+    /* Returns true if huge pages were requested successfully (with madvise, the
+       kernel may still back some or all of the buffer with normal pages) */
+    bool uses_huge_pages() const{
+        return huge;
+    }
+
+private:
+    void* memory {nullptr};
+    std::size_t length {0};
+    std::size_t mapped_length {0};
+    bool huge {false};
+};
+
+
+#endif
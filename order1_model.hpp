@@ -0,0 +1,160 @@
+/* order1_model.hpp
+
+   Adaptive order-1 context model (see static_model.hpp for the model interface):
+   the probability of each symbol is conditioned on the symbol before it, using
+   a separate adaptive frequency table for each of the 256 possible contexts.
+   As in AdaptiveModel, every symbol starts with a frequency of 1, each coded
+   symbol has its frequency (in the table of its context) increased by INCREMENT,
+   and a table's frequencies are halved whenever its total exceeds MAX_TOTAL (or
+   a smaller limit given to the constructor).
+
+   Each context's table is laid out for locality rather than stored as one flat
+   array: the alphabet is split into groups of 16 symbols (with the EOF symbol in
+   a group of its own), each group's frequencies are stored as 16 u16 values
+   (half of a cache line), and the cumulative frequency at the start of each group
+   is stored in a single cache line at the start of the table. Looking up or
+   updating a symbol therefore touches just two cache lines (the group totals and
+   the symbol's group), and the short loops over them are easily vectorized.
+*/
+
+#ifndef ORDER1_MODEL_HPP
+#define ORDER1_MODEL_HPP
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include "coder_stats.hpp"
+
+/* These definitions are more reliable for fixed width types than using "int" and assuming its width */
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+
+class Order1Model{
+public:
+    static constexpr u32 EOF_SYMBOL = 256;
+
+    /* Amount added to a symbol's frequency each time it is coded (in its context) */
+    static constexpr u32 INCREMENT = 32;
+
+    /* A context's frequencies are halved whenever its total exceeds this value
+       (which keeps every cumulative frequency within a u16) */
+    static constexpr u32 MAX_TOTAL = (1<<16) - 1 - INCREMENT;
+
+    /* Constructor (optionally with a lower limit on each context's total, at least 512) */
+    explicit Order1Model( u32 max_total = MAX_TOTAL ): tables(256), max_total {max_total}, context {0} {
+        for (auto& table: tables)
+            table.reset();
+    }
+
+    u64 total() const{
+        return tables[context].group_low[NUM_GROUPS];
+    }
+
+    void get_range(u32 symbol, u64& low, u64& high) const{
+        const ContextTable& table = tables[context];
+        const auto& group = table.frequencies[symbol/GROUP_SIZE];
+        u32 cumulative = table.group_low[symbol/GROUP_SIZE];
+        for (u32 i {0}; i < symbol%GROUP_SIZE; i++)
+            cumulative += group[i];
+        low = cumulative;
+        high = cumulative + group[symbol%GROUP_SIZE];
+    }
+
+    u32 find_symbol(u64 scaled_symbol, u64& low, u64& high) const{
+        const ContextTable& table = tables[context];
+        //The group is the last one starting at or below scaled_symbol (found by counting
+        //the groups after the first which start at or below it, without branching)
+        u32 group_index {0};
+        for (u32 g {1}; g < NUM_GROUPS; g++)
+            group_index += table.group_low[g] <= scaled_symbol;
+        //Then walk through the group's symbols
+        const auto& group = table.frequencies[group_index];
+        u32 cumulative = table.group_low[group_index];
+        u32 i {0};
+        while(i < GROUP_SIZE - 1 && cumulative + group[i] <= scaled_symbol)
+            cumulative += group[i++];
+        ARITH32_STAT_ADD(SearchCalls, 1);
+        ARITH32_STAT_ADD(SearchIterations, 1 + i);
+        low = cumulative;
+        high = cumulative + group[i];
+        return group_index*GROUP_SIZE + i;
+    }
+
+    void update(u32 symbol){
+        ContextTable& table = tables[context];
+        u32 group_index = symbol/GROUP_SIZE;
+        table.frequencies[group_index][symbol%GROUP_SIZE] += INCREMENT;
+        for (u32 g {0}; g < table.group_low.size(); g++)
+            table.group_low[g] += (g > group_index)? INCREMENT : 0;
+        if (table.group_low[NUM_GROUPS] > max_total){
+            //Halve every frequency (but don't let any nonzero frequency reach zero)
+            for (auto& group: table.frequencies)
+                for (auto& f: group)
+                    f = (f + 1)/2;
+            table.rebuild();
+        }
+        context = symbol & 0xff;
+    }
+
+    void get_byte_frequencies(std::array<u32, 256>& byte_frequencies) const{
+        const ContextTable& table = tables[context];
+        for (u32 g {0}; g < 256/GROUP_SIZE; g++)
+            for (u32 i {0}; i < GROUP_SIZE; i++)
+                byte_frequencies[g*GROUP_SIZE + i] = table.frequencies[g][i];
+    }
+
+    /* Move to the context after the given symbol without counting the symbol (for
+       models which code some symbols with their own statistics, like HashedContextModel) */
+    void skip(u32 symbol){
+        context = symbol & 0xff;
+    }
+
+    void remove_eof_symbol(){
+        for (auto& table: tables){
+            table.frequencies[EOF_SYMBOL/GROUP_SIZE][EOF_SYMBOL%GROUP_SIZE] = 0;
+            table.rebuild();
+        }
+    }
+
+private:
+    static constexpr u32 GROUP_SIZE = 16;
+    static constexpr u32 NUM_GROUPS = 17; //16 groups of bytes, then one holding just the EOF symbol
+
+    struct alignas(64) ContextTable{
+        //group_low[g] is the total frequency of the groups before group g
+        //(so group_low[NUM_GROUPS] is the total of the table); the entries
+        //after that are unused (and only pad the array to a cache line).
+        std::array<u16, 32> group_low;
+        std::array<std::array<u16, GROUP_SIZE>, NUM_GROUPS> frequencies;
+
+        /* Give every symbol a frequency of 1 */
+        void reset(){
+            for (auto& group: frequencies)
+                group.fill(0);
+            for (u32 symbol {0}; symbol <= EOF_SYMBOL; symbol++)
+                frequencies[symbol/GROUP_SIZE][symbol%GROUP_SIZE] = 1;
+            rebuild();
+        }
+
+        /* Recompute group_low from the frequencies */
+        void rebuild(){
+            u32 cumulative {0};
+            for (u32 g {0}; g < group_low.size(); g++){
+                group_low[g] = cumulative;
+                if (g < NUM_GROUPS)
+                    for (u16 f: frequencies[g])
+                        cumulative += f;
+            }
+        }
+    };
+
+    std::vector<ContextTable> tables;
+    u32 max_total;
+    u32 context;   //The previous symbol
+};
+
+
+#endif
@@ -14,7 +14,12 @@
 #define OUTPUT_STREAM_HPP
 
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
 #include <cstdint>
+#include "coder_stats.hpp"
 
 /* These definitions are more reliable for fixed width types than using "int" and assuming its width */
 using u8 = std::uint8_t;
@@ -55,6 +60,12 @@ public:
         push_bytes(rest...);
     }
 
+    /* Push count bytes from source into the stream */
+    void write_bytes(const u8* source, std::size_t count){
+        for (std::size_t i {0}; i < count; i++)
+            push_byte(source[i]);
+    }
+
     /* Push a 32 bit unsigned integer value (LSB first) */
     void push_u32(u32 i){
         push_bits(i,32);
@@ -81,6 +92,12 @@ public:
             output_byte();
     }
 
+    /* Push count copies of the bit b into the stream */
+    void push_repeated(u32 b, u64 count){
+        for (u64 i {0}; i < count; i++)
+            push_bit(b);
+    }
+
     /* Flush the currently stored bits to the output stream */
     /* The value of fill_bit is used for any padding bits emitted. */
     void flush_to_byte(u32 fill_bit = 0){
@@ -91,6 +108,7 @@ public:
 
 private:
     void output_byte(){
+        ARITH32_STAT_ADD(BytesWritten, 1);
         outfile.put((unsigned char)bitvec);
         bitvec = 0;
         numbits = 0;
@@ -101,4 +119,164 @@ private:
 };
 
 
+
+/* Word-at-a-time variant of OutputBitStream (with an identical bit ordering).
+
+   Bits accumulate (LSB first) in a 64 bit register, which is copied into a large
+   internal byte buffer one whole word at a time whenever it fills up. The buffer
+   is only handed to the underlying std::ostream once it is full (or when the 
+   stream is flushed/destroyed), so push_bits(b, n) costs a constant number of
+   shifts and ORs instead of n calls to push_bit, and there is one ostream::write
+   per BUFFER_SIZE bytes instead of one ostream::put per byte.
+
+   The stream can also be constructed around a std::vector<u8>, in which case
+   the encoded bytes are appended to the vector instead.
+*/
+class WordOutputBitStream{
+public:
+    /* Size (in bytes) of the internal output buffer */
+    static constexpr std::size_t BUFFER_SIZE = 1<<16;
+
+    /* Constructor */
+    WordOutputBitStream( std::ostream& output_stream ): bitbuf {0}, numbits {0}, buffer(BUFFER_SIZE), buffer_pos {0}, outfile {&output_stream}, outvec {nullptr} {
+
+    }
+
+    /* Constructor (append the output to the provided vector) */
+    WordOutputBitStream( std::vector<u8>& output_vector ): bitbuf {0}, numbits {0}, buffer(BUFFER_SIZE), buffer_pos {0}, outfile {nullptr}, outvec {&output_vector} {
+
+    }
+
+    /* Destructor (output any leftover bits, padding the last byte with zeros) */
+    ~WordOutputBitStream(){
+        flush();
+    }
+
+    /* Push an entire byte into the stream, with the least significant bit pushed first */
+    void push_byte(u8 b){
+        push_bits(b,8);
+    }
+
+    /* Notational convenience for pushing multiple bytes (see OutputBitStream) */
+    void push_bytes(){
+        //Base case
+    }
+    template<typename T, typename ...Ts>
+    void push_bytes(T v1, Ts... rest){
+        push_byte(v1);
+        push_bytes(rest...);
+    }
+
+    /* Push count bytes from source into the stream. If the stream is at a byte boundary,
+       the bytes are copied into the output buffer directly instead of one at a time. */
+    void write_bytes(const u8* source, std::size_t count){
+        if (numbits%8 == 0){
+            //Fill the bit register first, so that the copy starts with an empty register
+            while(count > 0 && numbits > 0){
+                push_byte(*source++);
+                count--;
+            }
+            while(count > 0){
+                if (buffer_pos == BUFFER_SIZE)
+                    flush_buffer();
+                std::size_t length = std::min(count, BUFFER_SIZE - buffer_pos);
+                std::memcpy(buffer.data() + buffer_pos, source, length);
+                buffer_pos += length;
+                source += length;
+                count -= length;
+            }
+        }
+        //Any remaining bytes are unaligned
+        for (std::size_t i {0}; i < count; i++)
+            push_byte(source[i]);
+    }
+
+    /* Push a 32 bit unsigned integer value (LSB first) */
+    void push_u32(u32 i){
+        push_bits(i,32);
+    }
+    /* Push a 16 bit unsigned short value (LSB first) */
+    void push_u16(u16 i){
+        push_bits(i,16);
+    }
+
+    /* Push the lowest order num_bits bits from b into the stream
+       with the least significant bit pushed first (num_bits must be at most 32)
+    */
+    void push_bits(u32 b, u32 num_bits){
+        u64 v = (u64)b & (((u64)1<<num_bits) - 1);
+        bitbuf |= v<<numbits;
+        numbits += num_bits;
+        if (numbits >= 64){
+            //The register is full, so move it into the buffer and keep the 
+            //bits of v that didn't fit. Since num_bits <= 32, the old value of numbits 
+            //must have been at least 32 here, so neither shift below is by 64.
+            output_word(bitbuf);
+            numbits -= 64;
+            bitbuf = numbits? v>>(num_bits - numbits) : 0;
+        }
+    }
+
+    /* Push a single bit b (stored as the LSB of an unsigned int)
+       into the stream */ 
+    void push_bit(u32 b){
+        push_bits(b,1);
+    }
+
+    /* Push count copies of the bit b into the stream */
+    void push_repeated(u32 b, u64 count){
+        u32 pattern = (b&1)? 0xffffffff : 0;
+        for(; count >= 32; count -= 32)
+            push_bits(pattern,32);
+        push_bits(pattern,(u32)count);
+    }
+
+    /* Pad the stream to a byte boundary */
+    /* The value of fill_bit is used for any padding bits emitted. */
+    void flush_to_byte(u32 fill_bit = 0){
+        push_repeated(fill_bit, (8 - (numbits&7))&7);
+    }
+
+    /* Pad the stream to a byte boundary with zeros, then pass everything 
+       buffered so far to the underlying std::ostream (or vector) */
+    void flush(){
+        flush_to_byte();
+        if (buffer_pos + 8 > BUFFER_SIZE)
+            flush_buffer();
+        for(u32 i {0}; i < numbits; i += 8)
+            buffer[buffer_pos++] = (u8)(bitbuf>>i);
+        bitbuf = 0;
+        numbits = 0;
+        flush_buffer();
+    }
+
+private:
+    void output_word(u64 word){
+        if (buffer_pos + 8 > BUFFER_SIZE)
+            flush_buffer();
+        //Store the word in little endian order (so the first bit pushed ends
+        //up in the LSB of the first byte, as in OutputBitStream). Compilers
+        //turn this loop into a single store on little endian machines.
+        for(u32 i {0}; i < 8; i++)
+            buffer[buffer_pos+i] = (u8)(word>>(8*i));
+        buffer_pos += 8;
+    }
+    void flush_buffer(){
+        ARITH32_STAT_CYCLES(IoCycles);
+        ARITH32_STAT_ADD(BytesWritten, buffer_pos);
+        if (outfile)
+            outfile->write((const char*)buffer.data(), buffer_pos);
+        else
+            outvec->insert(outvec->end(), buffer.begin(), buffer.begin() + buffer_pos);
+        buffer_pos = 0;
+    }
+    u64 bitbuf;
+    u32 numbits;
+    std::vector<u8> buffer;
+    std::size_t buffer_pos;
+    std::ostream* outfile;
+    std::vector<u8>* outvec;
+};
+
+
 #endif 
\ No newline at end of file
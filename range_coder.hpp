@@ -0,0 +1,210 @@
+/* range_coder.hpp
+
+   Byte-oriented range coder (in the style of the LZMA range coder), as an
+   alternative to the bitwise arithmetic coder in arith_coder.hpp.
+
+   RangeEncoder and RangeDecoder have the same interface as ArithEncoder and
+   ArithDecoder and use the same probability models, but instead of
+   renormalizing one bit at a time (and tracking underflow bits), they keep
+   a 32-bit range which is only renormalized once it drops below 2^24, at
+   which point a whole byte is shifted out. Underflow is handled by allowing
+   the low end of the interval to carry into bytes which have not been
+   written yet: the most recent byte (and any run of 0xff bytes after it)
+   is held back until it is certain that no carry can reach it.
+
+   This costs a little compression (since the range is only 24 to 32 bits
+   wide instead of 31 to 32 bits, and the rounding loss is not redistributed),
+   but needs one renormalization step per output byte instead of one per bit.
+
+   The model's total must be at most 2^16 (so that range/total is never zero).
+*/
+
+#ifndef RANGE_CODER_HPP
+#define RANGE_CODER_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include "input_stream.hpp"
+#include "output_stream.hpp"
+#include "static_model.hpp"
+#include "coder_stats.hpp"
+
+
+/* Divide the range by the model's total (using a shift for power-of-two totals) */
+template<typename Model>
+inline u32 range_per_unit(const Model& model, u32 range){
+    if constexpr (PowerOfTwoModel<Model>)
+        return range>>Model::TOTAL_BITS;
+    else
+        return range/(u32)model.total();
+}
+
+
+
+template<typename Model, typename OutStream>
+class RangeEncoder{
+public:
+    /* The range is renormalized whenever it drops below this value */
+    static constexpr u32 TOP = 1<<24;
+
+    /* Constructor */
+    RangeEncoder( Model& model, OutStream& stream ): model {model}, stream {stream}, low {0}, range {~0U}, cache {0}, cache_size {1} {
+
+    }
+
+    /* Encode every byte of the provided buffer */
+    void encode(const u8* data, std::size_t length){
+        for(std::size_t i {0}; i < length; i++)
+            encode_symbol(data[i]);
+    }
+
+    /* Encode a single symbol */
+    void encode_symbol(u32 symbol){
+        ARITH32_STAT_CYCLES(EncodeCycles);
+        ARITH32_STAT_ADD(SymbolsEncoded, 1);
+        assert(model.total() <= (1<<16));
+        u64 symbol_range_low, symbol_range_high;
+        model.get_range(symbol, symbol_range_low, symbol_range_high);
+        u32 r = range_per_unit(model, range);
+        low += (u64)r*symbol_range_low;
+        range = r*(u32)(symbol_range_high - symbol_range_low);
+
+        {
+            ARITH32_STAT_CYCLES(ModelCycles);
+            model.update(symbol);
+        }
+
+        while(range < TOP){
+            ARITH32_STAT_ADD(RenormalizationShifts, 1);
+            range <<= 8;
+            shift_low();
+        }
+    }
+
+    /* Encode the EOF symbol and flush the remaining bytes of low to the stream
+       (no further symbols may be encoded afterward) */
+    void finish(){
+        encode_symbol(Model::EOF_SYMBOL);
+        finish_without_eof();
+    }
+
+    /* Flush the remaining bytes of low to the stream without encoding the EOF symbol, for
+       streams whose length is stored separately (no further symbols may be encoded afterward) */
+    void finish_without_eof(){
+        for(int i = 0; i < 5; i++)
+            shift_low();
+    }
+
+private:
+    /* Shift the top byte out of low (bits 24 - 31, plus a possible carry in bit 32) */
+    void shift_low(){
+        if ((u32)low < 0xff000000U || (low>>32) != 0){
+            //The held back bytes are now final: either there was a carry into them
+            //(which cannot happen twice) or the byte being shifted out is not 0xff
+            //(so no future carry can propagate past it).
+            u8 carry = low>>32;
+            u8 held_byte = cache;
+            do{
+                stream.push_byte((u8)(held_byte + carry));
+                held_byte = 0xff;
+            }while(--cache_size != 0);
+            cache = (u8)(low>>24);
+        }
+        //Otherwise the byte shifted out is 0xff, which a later carry could still
+        //change, so it just extends the run of held back bytes.
+        cache_size++;
+        low = (low & 0x00ffffff)<<8;
+    }
+
+    Model& model;
+    OutStream& stream;
+    u64 low;          //33 bits are used (bit 32 is the carry)
+    u32 range;
+    u8 cache;         //The held back byte
+    u64 cache_size;   //The number of held back bytes (the cache plus a run of 0xff bytes)
+};
+
+
+
+template<typename Model, typename InStream>
+class RangeDecoder{
+public:
+    static constexpr u32 TOP = 1<<24;
+
+    /* Constructor (reads the first 5 bytes of the encoded stream) */
+    RangeDecoder( Model& model, InStream& stream ): model {model}, stream {stream}, code {0}, range {~0U}, done {false} {
+        //The first byte written by the encoder is always 0 (it is the initial
+        //value of the cache), so it just shifts out of code.
+        for(int i = 0; i < 5; i++)
+            code = (code<<8) | stream.read_byte();
+    }
+
+    /* Decode symbols into the provided buffer until either the buffer is full or
+       the EOF symbol is reached. Returns the number of bytes written. */
+    std::size_t decode(u8* output, std::size_t capacity){
+        std::size_t length {0};
+        while(length < capacity && !done){
+            u32 symbol = decode_symbol();
+            if (symbol == Model::EOF_SYMBOL)
+                break;
+            output[length++] = symbol;
+        }
+        return length;
+    }
+
+    /* Returns true once the EOF symbol has been decoded */
+    bool finished() const{
+        return done;
+    }
+
+    /* Decode a single symbol */
+    u32 decode_symbol(){
+        ARITH32_STAT_CYCLES(DecodeCycles);
+        ARITH32_STAT_ADD(SymbolsDecoded, 1);
+        u32 r = range_per_unit(model, range);
+        //code is less than range (for a valid stream), so this is at most total,
+        //and can only equal total in the unused space left at the top of the
+        //range by the rounding of r.
+        u64 scaled_symbol = std::min<u64>(code/r, model.total() - 1);
+
+        u64 symbol_range_low, symbol_range_high;
+        u32 symbol;
+        {
+            ARITH32_STAT_CYCLES(SearchCycles);
+            symbol = model.find_symbol(scaled_symbol, symbol_range_low, symbol_range_high);
+        }
+
+        if (symbol == Model::EOF_SYMBOL){
+            done = true;
+            return symbol;
+        }
+
+        code -= r*(u32)symbol_range_low;
+        range = r*(u32)(symbol_range_high - symbol_range_low);
+
+        {
+            ARITH32_STAT_CYCLES(ModelCycles);
+            model.update(symbol);
+        }
+
+        while(range < TOP){
+            ARITH32_STAT_ADD(RenormalizationShifts, 1);
+            range <<= 8;
+            code = (code<<8) | stream.read_byte();
+        }
+        return symbol;
+    }
+
+private:
+    Model& model;
+    InStream& stream;
+    u32 code;    //The offset of the encoded value from the low end of the current range
+    u32 range;
+    bool done;
+};
+
+
+#endif
@@ -0,0 +1,174 @@
+/* rans_coder.hpp
+
+   rANS (range asymmetric numeral systems) encoder and decoder, as an
+   alternative to the coders in arith_coder.hpp and range_coder.hpp.
+
+   RansEncoder and RansDecoder have the same interface as the other coders,
+   but only work with static models whose total is a power of two, 2^n with
+   n <= 16 (PowerOfTwoStaticModel and TwoPassModel), since rANS codes the
+   symbols in the opposite order from the one in which they are decoded.
+   The encoder therefore buffers every symbol until finish() is called, then
+   encodes them (along with the EOF symbol) from last to first.
+
+   The state x is kept in [L, 2^32) with L = 2^16 and is renormalized 16 bits
+   at a time, so each symbol needs at most one renormalization step.
+   Decoding a symbol only needs a table lookup (the model's slot-to-symbol
+   table), one multiply and one conditional renormalization:
+       slot = x mod 2^n
+       s = symbol containing slot, with range [low, high)
+       x = (high - low)*(x >> n) + slot - low
+       if x < L, shift in 16 more bits
+
+   Stream format: the final encoder state (32 bits), followed by the 16 bit
+   words emitted by the encoder in reverse order (all LSB first).
+*/
+
+#ifndef RANS_CODER_HPP
+#define RANS_CODER_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "input_stream.hpp"
+#include "output_stream.hpp"
+#include "static_model.hpp"
+#include "coder_stats.hpp"
+
+
+/* Models which can be used with the rANS coders */
+template<typename Model>
+concept RansModel = PowerOfTwoModel<Model> && (Model::TOTAL_BITS <= 16);
+
+inline constexpr u32 RANS_L = 1<<16; //Lower bound of the normalized state interval
+
+
+
+template<RansModel Model, typename OutStream>
+class RansEncoder{
+public:
+    /* Constructor */
+    RansEncoder( Model& model, OutStream& stream ): model {model}, stream {stream} {
+
+    }
+
+    /* Encode every byte of the provided buffer (the symbols are only buffered
+       until finish() is called) */
+    void encode(const u8* data, std::size_t length){
+        symbols.insert(symbols.end(), data, data + length);
+    }
+
+    /* Encode a single byte (which is only buffered until finish() is called; the EOF
+       symbol is only encoded by finish()) */
+    void encode_symbol(u32 symbol){
+        symbols.push_back(symbol);
+    }
+
+    /* Encode all of the buffered symbols followed by the EOF symbol and write
+       the result to the stream (no further symbols may be encoded afterward) */
+    void finish(){
+        encode_buffered(true);
+    }
+
+    /* Encode all of the buffered symbols (without the EOF symbol, for streams whose
+       length is stored separately) and write the result to the stream */
+    void finish_without_eof(){
+        encode_buffered(false);
+    }
+
+private:
+    void encode_buffered(bool with_eof){
+        ARITH32_STAT_CYCLES(EncodeCycles);
+        ARITH32_STAT_ADD(SymbolsEncoded, symbols.size() + with_eof);
+        std::vector<u16> words {};
+        u32 x = RANS_L;
+        auto encode_one = [&](u32 symbol){
+            u64 low, high;
+            model.get_range(symbol, low, high);
+            u32 frequency = high - low;
+            //Renormalize first, so that the new state stays below 2^32 (x_max is 2^32
+            //for a symbol with the whole total, which never needs renormalizing)
+            u64 x_max = ((u64)(RANS_L>>Model::TOTAL_BITS)<<16)*frequency;
+            if (x >= x_max){
+                words.push_back(x & 0xffff);
+                x >>= 16;
+            }
+            x = ((x/frequency)<<Model::TOTAL_BITS) + (x%frequency) + (u32)low;
+        };
+        //The EOF symbol is decoded last, so it is encoded first
+        if (with_eof)
+            encode_one(Model::EOF_SYMBOL);
+        for (std::size_t i = symbols.size(); i > 0; i--)
+            encode_one(symbols[i-1]);
+        symbols.clear();
+        ARITH32_STAT_ADD(RenormalizationShifts, words.size());
+
+        stream.push_u32(x);
+        for (std::size_t i = words.size(); i > 0; i--)
+            stream.push_u16(words[i-1]);
+    }
+
+    Model& model;
+    OutStream& stream;
+    std::vector<u8> symbols {};
+};
+
+
+
+template<RansModel Model, typename InStream>
+class RansDecoder{
+public:
+    /* Constructor (reads the initial state from the stream) */
+    RansDecoder( Model& model, InStream& stream ): model {model}, stream {stream}, x {0}, done {false} {
+        x = stream.read_u32();
+    }
+
+    /* Decode symbols into the provided buffer until either the buffer is full or
+       the EOF symbol is reached. Returns the number of bytes written. */
+    std::size_t decode(u8* output, std::size_t capacity){
+        std::size_t length {0};
+        while(length < capacity && !done){
+            u32 symbol = decode_symbol();
+            if (symbol == Model::EOF_SYMBOL)
+                break;
+            output[length++] = symbol;
+        }
+        return length;
+    }
+
+    /* Returns true once the EOF symbol has been decoded */
+    bool finished() const{
+        return done;
+    }
+
+    /* Decode a single symbol */
+    u32 decode_symbol(){
+        ARITH32_STAT_CYCLES(DecodeCycles);
+        ARITH32_STAT_ADD(SymbolsDecoded, 1);
+        constexpr u32 SLOT_MASK = (1U<<Model::TOTAL_BITS) - 1;
+        u32 slot = x & SLOT_MASK;
+        u64 low, high;
+        u32 symbol;
+        {
+            ARITH32_STAT_CYCLES(SearchCycles);
+            symbol = model.find_symbol(slot, low, high);
+        }
+        x = (u32)(high - low)*(x>>Model::TOTAL_BITS) + slot - (u32)low;
+        if (x < RANS_L){
+            ARITH32_STAT_ADD(RenormalizationShifts, 1);
+            x = (x<<16) | stream.read_u16();
+        }
+        if (symbol == Model::EOF_SYMBOL)
+            done = true;
+        return symbol;
+    }
+
+private:
+    Model& model;
+    InStream& stream;
+    u32 x;
+    bool done;
+};
+
+
+#endif
@@ -0,0 +1,389 @@
+/* rans_interleaved.hpp
+
+   Interleaved rANS coder: N independent rANS states (N = 8, 16 or 32) share
+   a single stream of 16 bit words, with symbol i coded by state i mod N.
+   Since consecutive symbols do not depend on each other's states, the decoder
+   can update a whole group of N states at once using SIMD instructions
+   (a gather for the table lookups, and a compare/expand for renormalizing
+   only the lanes whose state has dropped below L). AVX2 and AVX-512 kernels
+   are selected at runtime (see cpu_dispatch.hpp) if the CPU supports them,
+   with a portable scalar kernel (which produces identical results) used otherwise.
+
+   InterleavedRansEncoder and InterleavedRansDecoder have the same interface as
+   the other coders and work with any static model (not just power-of-two ones):
+   the coder normalizes the model's frequencies to its own total of 2^12, so
+   that the decoding table (slot -> frequency, slot offset and symbol, packed
+   into 32 bits) has 4096 entries and stays in L1 cache. The EOF symbol keeps
+   a frequency of 1 in this table (which also keeps every frequency below 2^12)
+   but is never coded, since the stream stores the number of symbols instead.
+   As with RansEncoder, the encoder buffers every symbol until finish().
+
+   Each state follows the same rules as in rans_coder.hpp (kept in [2^16, 2^32)
+   and renormalized 16 bits at a time). The encoder codes the symbols from last
+   to first, so the words are written in reverse order of emission and the
+   decoder reads them front to back: within each group, lanes which need to
+   renormalize take the next words in increasing lane order.
+
+   Stream format (all LSB first):
+     64 bits      Number of symbols
+     64 bits      Number of 16 bit words
+     32 bits * N  Final encoder state of each lane (lane 0 first)
+     16 bits * w  Words
+*/
+
+#ifndef RANS_INTERLEAVED_HPP
+#define RANS_INTERLEAVED_HPP
+
+#include <array>
+#include <vector>
+#include <bit>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include "input_stream.hpp"
+#include "output_stream.hpp"
+#include "static_model.hpp"
+#include "rans_coder.hpp"
+#include "cpu_dispatch.hpp"
+#include "coder_stats.hpp"
+
+
+inline constexpr u32 RANS_TABLE_BITS = 12;
+inline constexpr u32 RANS_TABLE_SIZE = 1<<RANS_TABLE_BITS;
+inline constexpr u32 RANS_TABLE_MASK = RANS_TABLE_SIZE - 1;
+
+
+/* The normalized frequencies of a model, along with the decoding table
+   (each entry holds the frequency in bits 0 - 11, the offset of the slot within
+    its symbol's range in bits 12 - 23 and the symbol in bits 24 - 31) */
+struct InterleavedRansTable{
+    std::array<u32, StaticModel::EOF_SYMBOL+1> frequencies;
+    std::array<u32, StaticModel::EOF_SYMBOL+1> cumulative;
+    alignas(64) std::array<u32, RANS_TABLE_SIZE> slots;
+
+    template<StaticFrequencyModel Model>
+    explicit InterleavedRansTable( const Model& model ){
+        frequencies = normalized_byte_frequencies(model, RANS_TABLE_BITS);
+        u32 total {0};
+        for (u32 symbol {0}; symbol <= StaticModel::EOF_SYMBOL; symbol++){
+            cumulative.at(symbol) = total;
+            for (u32 i {0}; i < frequencies.at(symbol); i++)
+                slots.at(total + i) = frequencies.at(symbol) | (i<<12) | ((symbol & 0xff)<<24);
+            total += frequencies.at(symbol);
+        }
+    }
+};
+
+
+/* Decoding kernels: each decodes num_groups groups of num_states symbols (one per
+   state, in lane order) into output, reading renormalization words from words.
+   A kernel stops early (returning the number of groups decoded) if fewer than
+   num_states words remain before words_end, since it cannot tell how many words
+   a group will need. This is normal near the end of any stream (e.g. when the
+   last few groups need fewer than num_states words between them), and the caller
+   just decodes the rest with the scalar rules. The words array must be readable
+   for 16 elements past words_end. */
+using RansDecodeKernel = std::size_t (*)(u32* states, u32 num_states, const u32* table, const u16*& words, const u16* words_end, u8* output, std::size_t num_groups);
+
+inline std::size_t rans_decode_groups_scalar(u32* states, u32 num_states, const u32* table, const u16*& words, const u16* words_end, u8* output, std::size_t num_groups){
+    const u16* next = words;
+    std::size_t group {0};
+    for (; group < num_groups && (std::size_t)(words_end - next) >= num_states; group++){
+        for (u32 lane {0}; lane < num_states; lane++){
+            u32 x = states[lane];
+            u32 entry = table[x & RANS_TABLE_MASK];
+            x = (entry & RANS_TABLE_MASK)*(x>>RANS_TABLE_BITS) + ((entry>>12) & RANS_TABLE_MASK);
+            if (x < RANS_L)
+                x = (x<<16) | *next++;
+            states[lane] = x;
+            *output++ = entry>>24;
+        }
+    }
+    words = next;
+    return group;
+}
+
+#ifdef ARITH32_X86_DISPATCH
+
+/* For each 8 bit mask of lanes to renormalize, the index of the word taken by each
+   lane (the number of renormalizing lanes below it) */
+inline constexpr auto RANS_AVX2_PERMUTATIONS = []{
+    std::array<std::array<u32, 8>, 256> permutations {};
+    for (u32 mask {0}; mask < 256; mask++){
+        u32 count {0};
+        for (u32 lane {0}; lane < 8; lane++){
+            permutations[mask][lane] = count;
+            count += (mask>>lane) & 1;
+        }
+    }
+    return permutations;
+}();
+
+ARITH32_TARGET_AVX2
+inline std::size_t rans_decode_groups_avx2(u32* states, u32 num_states, const u32* table, const u16*& words, const u16* words_end, u8* output, std::size_t num_groups){
+    const __m256i table_mask = _mm256_set1_epi32(RANS_TABLE_MASK);
+    const __m256i symbol_bytes = _mm256_setr_epi8(3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                   3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i symbol_order = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+    const u16* next = words;
+    std::size_t group {0};
+    for (; group < num_groups && (std::size_t)(words_end - next) >= num_states; group++){
+        for (u32 lane {0}; lane < num_states; lane += 8){
+            __m256i x = _mm256_loadu_si256((const __m256i*)(states + lane));
+            __m256i entry = _mm256_i32gather_epi32((const int*)table, _mm256_and_si256(x, table_mask), 4);
+            __m256i frequency = _mm256_and_si256(entry, table_mask);
+            __m256i offset = _mm256_and_si256(_mm256_srli_epi32(entry, 12), table_mask);
+            x = _mm256_add_epi32(_mm256_mullo_epi32(frequency, _mm256_srli_epi32(x, RANS_TABLE_BITS)), offset);
+
+            //Lanes with x < 2^16 each take the next word, in lane order
+            __m256i renormalize = _mm256_cmpeq_epi32(_mm256_srli_epi32(x, 16), _mm256_setzero_si256());
+            u32 mask = _mm256_movemask_ps(_mm256_castsi256_ps(renormalize));
+            __m256i next_words = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)next));
+            next_words = _mm256_permutevar8x32_epi32(next_words, _mm256_loadu_si256((const __m256i*)RANS_AVX2_PERMUTATIONS[mask].data()));
+            x = _mm256_blendv_epi8(x, _mm256_or_si256(_mm256_slli_epi32(x, 16), next_words), renormalize);
+            next += std::popcount(mask);
+            _mm256_storeu_si256((__m256i*)(states + lane), x);
+
+            __m256i symbols = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(entry, symbol_bytes), symbol_order);
+            _mm_storel_epi64((__m128i*)output, _mm256_castsi256_si128(symbols));
+            output += 8;
+        }
+    }
+    words = next;
+    return group;
+}
+
+//GCC 12 warns about the deliberately undefined vectors inside the AVX-512 intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+ARITH32_TARGET_AVX512
+inline std::size_t rans_decode_groups_avx512(u32* states, u32 num_states, const u32* table, const u16*& words, const u16* words_end, u8* output, std::size_t num_groups){
+    const __m512i table_mask = _mm512_set1_epi32(RANS_TABLE_MASK);
+    const __m512i lower_bound = _mm512_set1_epi32(RANS_L);
+    const u16* next = words;
+    std::size_t group {0};
+    for (; group < num_groups && (std::size_t)(words_end - next) >= num_states; group++){
+        for (u32 lane {0}; lane < num_states; lane += 16){
+            __m512i x = _mm512_loadu_si512(states + lane);
+            __m512i entry = _mm512_i32gather_epi32(_mm512_and_si512(x, table_mask), table, 4);
+            __m512i frequency = _mm512_and_si512(entry, table_mask);
+            __m512i offset = _mm512_and_si512(_mm512_srli_epi32(entry, 12), table_mask);
+            x = _mm512_add_epi32(_mm512_mullo_epi32(frequency, _mm512_srli_epi32(x, RANS_TABLE_BITS)), offset);
+
+            //Lanes with x < 2^16 each take the next word, in lane order
+            __mmask16 renormalize = _mm512_cmplt_epu32_mask(x, lower_bound);
+            __m512i next_words = _mm512_maskz_expand_epi32(renormalize, _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)next)));
+            x = _mm512_mask_or_epi32(x, renormalize, _mm512_slli_epi32(x, 16), next_words);
+            next += std::popcount((u32)renormalize);
+            _mm512_storeu_si512(states + lane, x);
+
+            _mm_storeu_si128((__m128i*)output, _mm512_cvtepi32_epi8(_mm512_srli_epi32(entry, 24)));
+            output += 16;
+        }
+    }
+    words = next;
+    return group;
+}
+#pragma GCC diagnostic pop
+
+#endif
+
+/* Returns the fastest kernel supported by the CPU for the given number of states
+   (the AVX-512 kernel needs a multiple of 16 states) */
+inline RansDecodeKernel rans_decode_kernel(u32 num_states){
+#ifdef ARITH32_X86_DISPATCH
+    static const RansDecodeKernel kernel_8 = select_kernel<RansDecodeKernel>({
+        .scalar = rans_decode_groups_scalar, .avx2 = rans_decode_groups_avx2});
+    static const RansDecodeKernel kernel_16 = select_kernel<RansDecodeKernel>({
+        .scalar = rans_decode_groups_scalar, .avx2 = rans_decode_groups_avx2, .avx512 = rans_decode_groups_avx512});
+    return num_states%16 == 0 ? kernel_16 : kernel_8;
+#else
+    return rans_decode_groups_scalar;
+#endif
+}
+
+
+
+template<StaticFrequencyModel Model, typename OutStream, u32 NumStates>
+class InterleavedRansEncoder{
+public:
+    /* Constructor */
+    InterleavedRansEncoder( Model& model, OutStream& stream ): table {model}, stream {stream} {
+
+    }
+
+    /* Encode every byte of the provided buffer (the symbols are only buffered
+       until finish() is called) */
+    void encode(const u8* data, std::size_t length){
+        symbols.insert(symbols.end(), data, data + length);
+    }
+
+    /* Encode a single symbol (which is only buffered until finish() is called) */
+    void encode_symbol(u32 symbol){
+        symbols.push_back(symbol);
+    }
+
+    /* Encode all of the buffered symbols and write the result to the stream
+       (no further symbols may be encoded afterward) */
+    void finish(){
+        ARITH32_STAT_CYCLES(EncodeCycles);
+        ARITH32_STAT_ADD(SymbolsEncoded, symbols.size());
+        std::vector<u16> words {};
+        std::array<u32, NumStates> states {};
+        states.fill(RANS_L);
+        for (std::size_t i = symbols.size(); i > 0; i--){
+            u32& x = states[(i-1)%NumStates];
+            u32 symbol = symbols[i-1];
+            u32 frequency = table.frequencies[symbol];
+            //Renormalize first, so that the new state stays below 2^32
+            u32 x_max = ((RANS_L>>RANS_TABLE_BITS)<<16)*frequency;
+            if (x >= x_max){
+                words.push_back(x & 0xffff);
+                x >>= 16;
+            }
+            x = ((x/frequency)<<RANS_TABLE_BITS) + (x%frequency) + table.cumulative[symbol];
+        }
+        ARITH32_STAT_ADD(RenormalizationShifts, words.size());
+
+        u64 num_symbols = symbols.size();
+        stream.push_u32((u32)num_symbols);
+        stream.push_u32((u32)(num_symbols>>32));
+        stream.push_u32((u32)words.size());
+        stream.push_u32((u32)((u64)words.size()>>32));
+        for (u32 x: states)
+            stream.push_u32(x);
+        for (std::size_t i = words.size(); i > 0; i--)
+            stream.push_u16(words[i-1]);
+        symbols.clear();
+    }
+
+private:
+    InterleavedRansTable table;
+    OutStream& stream;
+    std::vector<u8> symbols {};
+};
+
+
+
+template<StaticFrequencyModel Model, typename InStream, u32 NumStates>
+class InterleavedRansDecoder{
+public:
+    static_assert(NumStates%8 == 0 && NumStates <= 32);
+
+    /* The words of a stream which is not in memory are read in chunks of this many words */
+    static constexpr std::size_t WORD_CHUNK_SIZE = 1<<15;
+
+    /* Constructor (reads the entire encoded stream) */
+    InterleavedRansDecoder( Model& model, InStream& stream ): table {model}, num_symbols {0}, position {0}, done {false} {
+        num_symbols = stream.read_u32();
+        num_symbols |= (u64)stream.read_u32()<<32;
+        u64 num_words = stream.read_u32();
+        num_words |= (u64)stream.read_u32()<<32;
+        for (u32& x: states)
+            x = stream.read_u32();
+        //Each symbol produces at most one word (anything else is a corrupt stream)
+        num_words = std::min(num_words, num_symbols);
+        //(The SIMD kernels may load up to 16 words past the end)
+        if (const u8* data = stream.read_in_place(2*num_words)){
+            words.resize(num_words + 16);
+            std::memcpy(words.data(), data, 2*num_words);
+        }else{
+            //Either the input is not in memory or it has fewer than num_words words left, so the
+            //words are read a chunk at a time (so that a corrupt count can't allocate much more
+            //than the input itself), and a stream which runs out of words decodes nothing
+            for (u64 count {0}; count < num_words; count += WORD_CHUNK_SIZE){
+                std::size_t chunk_length = std::min<u64>(WORD_CHUNK_SIZE, num_words - count);
+                words.resize(count + chunk_length + 16);
+                stream.read_bytes((u8*)(words.data() + count), 2*chunk_length);
+                if (stream.bytes_past_end() > 0){
+                    num_symbols = num_words = 0;
+                    done = true;
+                }
+            }
+            words.resize(num_words + 16);
+        }
+        if constexpr (std::endian::native == std::endian::big)
+            for (u16& word: words)
+                word = (word>>8) | (word<<8);
+        next_word = words.data();
+        words_end = words.data() + num_words;
+        kernel = rans_decode_kernel(NumStates);
+    }
+
+    /* Decode symbols into the provided buffer until either the buffer is full or
+       every symbol has been decoded. Returns the number of bytes written. */
+    std::size_t decode(u8* output, std::size_t capacity){
+        ARITH32_STAT_CYCLES(DecodeCycles);
+        [[maybe_unused]] const u16* first_word = next_word;
+        std::size_t length {0};
+        //Decode single symbols until the next symbol is in lane 0
+        while(length < capacity && position < num_symbols && position%NumStates != 0)
+            output[length++] = decode_next();
+        //Then as many complete groups as possible
+        std::size_t num_groups = std::min<u64>((capacity - length)/NumStates, (num_symbols - position)/NumStates);
+        std::size_t decoded_groups = kernel(states.data(), NumStates, table.slots.data(), next_word, words_end, output + length, num_groups);
+        length += decoded_groups*NumStates;
+        position += decoded_groups*NumStates;
+        //Then any remaining symbols (in the last partial group)
+        while(length < capacity && position < num_symbols)
+            output[length++] = decode_next();
+        if (position == num_symbols)
+            done = true;
+        ARITH32_STAT_ADD(SymbolsDecoded, length);
+        ARITH32_STAT_ADD(RenormalizationShifts, next_word - first_word);
+        return length;
+    }
+
+    /* Returns true once every symbol has been decoded */
+    bool finished() const{
+        return done;
+    }
+
+    /* Returns the number of bytes read past the end of the words (which only happens
+       for a corrupt stream, and yields words of 0) */
+    u64 bytes_past_end() const{
+        return 2*missing_words;
+    }
+
+    /* Decode a single symbol (EOF_SYMBOL is returned once every symbol has been decoded) */
+    u32 decode_symbol(){
+        if (position == num_symbols){
+            done = true;
+            return Model::EOF_SYMBOL;
+        }
+        return decode_next();
+    }
+
+private:
+    /* Decode the next symbol with the scalar rules */
+    u8 decode_next(){
+        u32& x = states[position%NumStates];
+        u32 entry = table.slots[x & RANS_TABLE_MASK];
+        x = (entry & RANS_TABLE_MASK)*(x>>RANS_TABLE_BITS) + ((entry>>12) & RANS_TABLE_MASK);
+        if (x < RANS_L){
+            if (next_word < words_end){
+                x = (x<<16) | *next_word++;
+            }else{
+                x <<= 16;
+                missing_words++;
+            }
+        }
+        position++;
+        return entry>>24;
+    }
+
+    InterleavedRansTable table;
+    std::array<u32, NumStates> states;
+    std::vector<u16> words {};
+    const u16* next_word;
+    const u16* words_end;
+    RansDecodeKernel kernel;
+    u64 num_symbols;
+    u64 position;
+    u64 missing_words {0};   //The number of words read past words_end
+    bool done;
+};
+
+
+#endif
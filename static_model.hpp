@@ -0,0 +1,309 @@
+/* static_model.hpp
+
+   Static (fixed) probability model for the arithmetic coder in arith_coder.hpp.
+
+   Every probability model used with ArithEncoder/ArithDecoder provides
+   the following interface:
+
+     Model::EOF_SYMBOL          The symbol used to mark the end of the stream
+                                (the alphabet is [0, EOF_SYMBOL]).
+     u64 total()                The global cumulative frequency (at most 2^32 - 1).
+     void get_range(s, low, high)
+                                Set [low, high) to the cumulative frequency range
+                                of symbol s.
+     u32 find_symbol(scaled, low, high)
+                                Return the symbol s whose range [low, high) contains
+                                scaled (where 0 <= scaled < total()) and set low/high
+                                to that range.
+     void update(s)             Called by both the encoder and decoder after each
+                                symbol is coded (adaptive models adjust themselves
+                                here; for a static model this does nothing).
+     void remove_eof_symbol()   Give the EOF symbol a frequency of zero (before any
+                                symbols are coded), for streams whose length is stored
+                                separately, which leaves an alphabet of just the 256
+                                byte values with no probability spent on the EOF symbol.
+
+   Optionally, a model whose total is always 2^k can declare
+     static constexpr u32 TOTAL_BITS = k;
+   in which case the coders use shifts instead of dividing by total().
+
+   The adaptive models also provide
+     void get_byte_frequencies(frequencies)
+                                Set frequencies (a std::array<u32, 256>) to the
+                                frequency with which each byte value would be coded
+                                next, so that the model can also be coded one bit at
+                                a time (see BinarizedModel in apm_model.hpp).
+*/
+
+#ifndef STATIC_MODEL_HPP
+#define STATIC_MODEL_HPP
+
+#include <array>
+#include <bit>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <concepts>
+#include <cassert>
+#include <cstdint>
+#include "coder_stats.hpp"
+
+/* These definitions are more reliable for fixed width types than using "int" and assuming its width */
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+
+class StaticModel{
+public:
+    static constexpr u32 EOF_SYMBOL = 256;
+
+    /* The largest total for which a slot-to-symbol lookup table is built
+       (above this, find_symbol uses a binary search of CF_low) */
+    static constexpr u64 MAX_LOOKUP_SIZE = 1<<20;
+
+    using FrequencyTable = std::array<u32, EOF_SYMBOL+1>;
+
+    /* Constructor (use the default placeholder frequencies) */
+    StaticModel(): StaticModel(default_frequencies()) {
+
+    }
+
+    /* Constructor (use the provided frequency table) */
+    explicit StaticModel( const FrequencyTable& frequencies ){
+        set_frequencies(frequencies);
+    }
+
+    /* Create a static frequency table with a frequency of 1 for
+       all symbols except lowercase/uppercase letters (symbols 65-122) */
+    static FrequencyTable default_frequencies(){
+        FrequencyTable frequencies {};
+        frequencies.fill(1);
+
+        //Set the frequencies of letters (65 - 122) to 2
+        for(unsigned int i = 65; i <= 122; i++)
+            frequencies.at(i) = 2;
+
+        //Now set the frequencies of uppercase/lowercase vowels to 4
+        std::string vowels{"AEIOUaeiou"};
+        for(unsigned char c: vowels)
+            frequencies.at(c) = 4;
+        return frequencies;
+    }
+
+    /* Replace the frequency table (and rebuild the cumulative frequencies and lookup table) */
+    void set_frequencies( const FrequencyTable& frequencies ){
+        //Now compute cumulative frequencies for each symbol.
+        //We actually want the range [CF_low,CF_high] for each symbol,
+        //but since CF_low(i) = CF_high(i-1), we only really have to compute
+        //the array of lower bounds.
+
+        //The cumulative frequency range for each symbol i will be
+        //[ CF_low.at(i), CF_low.at(i+1) )
+        //(note that it's a half-open interval)
+        CF_low.at(0) = 0;
+        for (unsigned int i = 1; i < EOF_SYMBOL+2; i++){
+            CF_low.at(i) = CF_low.at(i-1) + frequencies.at(i-1);
+        }
+
+        //We also need to know the global cumulative frequency (of all
+        //symbols), which will be the denominator of the coder's formulas.
+        //It turns out this value is already stored as CF_low.at(max_symbol+1)
+        global_cumulative_frequency = CF_low.at(EOF_SYMBOL+1);
+
+        assert(global_cumulative_frequency <= 0xffffffff); //If this fails, frequencies must be scaled down
+
+        //Rather than searching CF_low for each decoded symbol, precompute a table which
+        //maps every slot in [0, global_cumulative_frequency) to the symbol whose range
+        //contains it, so that find_symbol becomes a single indexed load.
+        symbol_lookup.clear();
+        if (global_cumulative_frequency <= MAX_LOOKUP_SIZE){
+            symbol_lookup.resize(global_cumulative_frequency);
+            for (u32 symbol = 0; symbol <= EOF_SYMBOL; symbol++)
+                for (u64 slot = CF_low.at(symbol); slot < CF_low.at(symbol+1); slot++)
+                    symbol_lookup[slot] = symbol;
+        }
+    }
+
+    u64 total() const{
+        return global_cumulative_frequency;
+    }
+
+    void get_range(u32 symbol, u64& low, u64& high) const{
+        low = CF_low[symbol];
+        high = CF_low[symbol+1];
+    }
+
+    u32 find_symbol(u64 scaled_symbol, u64& low, u64& high) const{
+        u32 symbol;
+        ARITH32_STAT_ADD(SearchCalls, 1);
+        if (!symbol_lookup.empty()){
+            ARITH32_STAT_ADD(SearchIterations, 1);
+            symbol = symbol_lookup[scaled_symbol];
+        }else{
+            ARITH32_STAT_ADD(SearchIterations, std::bit_width(CF_low.size()));
+            //Find the last symbol whose CF_low is at most scaled_symbol
+            symbol = std::upper_bound(CF_low.begin(), CF_low.end(), scaled_symbol) - CF_low.begin() - 1;
+        }
+        get_range(symbol, low, high);
+        return symbol;
+    }
+
+    void update(u32){
+        //The model is static, so there is nothing to do
+    }
+
+    void remove_eof_symbol(){
+        FrequencyTable frequencies = get_frequencies();
+        frequencies.at(EOF_SYMBOL) = 0;
+        set_frequencies(frequencies);
+    }
+
+    /* Returns the frequency of each symbol */
+    FrequencyTable get_frequencies() const{
+        FrequencyTable frequencies {};
+        for (u32 symbol = 0; symbol <= EOF_SYMBOL; symbol++)
+            frequencies.at(symbol) = CF_low.at(symbol+1) - CF_low.at(symbol);
+        return frequencies;
+    }
+
+private:
+    std::array<u64, EOF_SYMBOL+2> CF_low {};
+    u64 global_cumulative_frequency {};
+    std::vector<u16> symbol_lookup {};
+};
+
+
+
+/* Rescale a frequency table (or a table of raw counts, with one u32 or u64 entry per
+   symbol) so that its total is exactly 2^total_bits, keeping every nonzero frequency 
+   at least 1 (so every symbol that could occur can still be coded).
+   The number of nonzero frequencies must be at most 2^total_bits.
+   A lone nonzero frequency is given 2^total_bits - 1 rather than the whole total,
+   with the remaining 1 given to a neighbouring symbol: a symbol with the whole total
+   would cost nothing to code, so a decoder could produce any number of them without
+   reading its input (and a corrupt length could never be detected). */
+template<typename Frequencies>
+inline StaticModel::FrequencyTable normalize_frequencies( const Frequencies& frequencies, u32 total_bits ){
+    static_assert(std::tuple_size<Frequencies>::value == StaticModel::EOF_SYMBOL+1);
+    const u64 target_total = (u64)1<<total_bits;
+    u64 original_total {0};
+    u32 nonzero_count {0};
+    for (u64 f: frequencies){
+        original_total += f;
+        nonzero_count += (f != 0);
+    }
+    assert(original_total > 0 && nonzero_count <= target_total);
+
+    StaticModel::FrequencyTable normalized {};
+    if (nonzero_count == 1){
+        u32 lone = std::find_if(frequencies.begin(), frequencies.end(), [](u64 f){ return f != 0; }) - frequencies.begin();
+        normalized.at(lone) = target_total - 1;
+        normalized.at(lone == 0? 1 : lone - 1) = 1;
+        return normalized;
+    }
+
+    //First scale every frequency proportionally (rounding down, but never to zero)
+    std::array<u64, StaticModel::EOF_SYMBOL+1> remainders {};
+    u64 normalized_total {0};
+    for (u32 i = 0; i < normalized.size(); i++){
+        if (frequencies.at(i) == 0)
+            continue;
+        u64 scaled = ((u64)frequencies.at(i)*target_total)/original_total;
+        remainders.at(i) = ((u64)frequencies.at(i)*target_total)%original_total;
+        normalized.at(i) = std::max<u64>(scaled, 1);
+        normalized_total += normalized.at(i);
+    }
+
+    //Rounding down loses less than 1 per symbol, so any shortfall is first given
+    //back to the symbols which lost the most to rounding
+    if (normalized_total < target_total){
+        std::array<u32, StaticModel::EOF_SYMBOL+1> order {};
+        for (u32 i = 0; i < order.size(); i++)
+            order.at(i) = i;
+        std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b){ return remainders.at(a) > remainders.at(b); });
+        for (u32 i = 0; i < order.size() && normalized_total < target_total && remainders.at(order.at(i)) > 0; i++){
+            normalized.at(order.at(i))++;
+            normalized_total++;
+        }
+    }
+
+    //Any remaining difference (e.g. from symbols rounded up to 1) is made up using
+    //the most frequent symbols (where it has the smallest relative effect).
+    while(normalized_total != target_total){
+        u32 largest = std::max_element(normalized.begin(), normalized.end()) - normalized.begin();
+        if (normalized_total < target_total){
+            normalized.at(largest) += target_total - normalized_total;
+            normalized_total = target_total;
+        }else{
+            u64 excess = std::min<u64>(normalized_total - target_total, normalized.at(largest)/2);
+            normalized.at(largest) -= excess;
+            normalized_total -= excess;
+        }
+    }
+    return normalized;
+}
+
+
+
+/* A static model whose frequencies are normalized to total exactly 2^TotalBits.
+   The coders in arith_coder.hpp detect the TOTAL_BITS member and replace the 
+   divisions by the global cumulative frequency with shifts.
+   (The default of 2^15 keeps the rounding loss small while the decoder's
+    lookup table still fits in 64KB.) */
+template<u32 TotalBits = 15>
+class PowerOfTwoStaticModel: public StaticModel{
+public:
+    static constexpr u32 TOTAL_BITS = TotalBits;
+
+    /* Constructor (use the default placeholder frequencies) */
+    PowerOfTwoStaticModel(): PowerOfTwoStaticModel(default_frequencies()) {
+
+    }
+
+    /* Constructor (use the provided frequency table, which will be normalized) */
+    explicit PowerOfTwoStaticModel( const FrequencyTable& frequencies ): StaticModel(normalize_frequencies(frequencies, TotalBits)) {
+
+    }
+
+    /* Replace the frequency table (which will be normalized) */
+    void set_frequencies( const FrequencyTable& frequencies ){
+        StaticModel::set_frequencies(normalize_frequencies(frequencies, TotalBits));
+    }
+
+    /* Remove the EOF symbol (renormalizing the other frequencies to the same total) */
+    void remove_eof_symbol(){
+        FrequencyTable frequencies = get_frequencies();
+        frequencies.at(EOF_SYMBOL) = 0;
+        set_frequencies(frequencies);
+    }
+};
+
+/* Models with a compile-time power-of-two total (see PowerOfTwoStaticModel) */
+template<typename Model>
+concept PowerOfTwoModel = requires { { Model::TOTAL_BITS } -> std::convertible_to<u32>; };
+
+/* Models with a fixed frequency table (StaticModel and the models derived from it) */
+template<typename Model>
+concept StaticFrequencyModel = std::derived_from<Model, StaticModel>;
+
+
+/* Normalize the byte frequencies of a static model to a total of 2^total_bits, for
+   coders which store the number of symbols instead of coding the EOF symbol. The
+   EOF symbol is given a frequency of 1 regardless (so no byte's frequency can reach
+   2^total_bits, and the table is valid even if no byte has a nonzero frequency). */
+template<StaticFrequencyModel Model>
+inline StaticModel::FrequencyTable normalized_byte_frequencies( const Model& model, u32 total_bits ){
+    StaticModel::FrequencyTable counts {};
+    u64 low, high;
+    for (u32 symbol {0}; symbol < StaticModel::EOF_SYMBOL; symbol++){
+        model.get_range(symbol, low, high);
+        counts.at(symbol) = high - low;
+    }
+    counts.at(StaticModel::EOF_SYMBOL) = 1;
+    return normalize_frequencies(counts, total_bits);
+}
+
+
+#endif
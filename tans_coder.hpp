@@ -0,0 +1,248 @@
+/* tans_coder.hpp
+
+   Table-driven tANS coder (in the style of FSE), for static models.
+
+   Like the coders in rans_interleaved.hpp, the coder normalizes the model's
+   frequencies to a total of L = 2^12, and the stream stores the number of
+   symbols instead of coding the EOF symbol. Each of the L table slots is
+   assigned to a symbol (spread through the table by a fixed step, with each
+   symbol getting as many slots as its normalized frequency), and the state is
+   an index into this table. Both directions are then reduced to table lookups:
+       decoding: entry = decode_table[state]
+                 symbol = entry.symbol
+                 state = entry.base + (next entry.num_bits bits of the stream)
+       encoding: (with state x in [L, 2L))
+                 num_bits = (x + delta_bits[s]) >> 16
+                 write the low num_bits bits of x
+                 x = encode_table[(x >> num_bits) + delta_state[s]]
+   so no multiplications or divisions are needed for either.
+
+   The tables only depend on the normalized frequencies, so they are cached
+   (see tans_tables) and shared by every coder (e.g. for each block in a block
+   container) which uses the same distribution.
+
+   As with rANS, the decoder runs in the opposite order from the encoder, so
+   the encoder buffers every symbol until finish() and then writes the bits
+   produced for each symbol from the last symbol's to the first's.
+
+   Stream format (all LSB first):
+     64 bits      Number of symbols
+     12 bits      Initial decoder state (the final encoder state minus L)
+     ...          For each symbol, in order, the bits read by the decoder
+*/
+
+#ifndef TANS_CODER_HPP
+#define TANS_CODER_HPP
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include "input_stream.hpp"
+#include "output_stream.hpp"
+#include "static_model.hpp"
+#include "coder_stats.hpp"
+
+
+inline constexpr u32 TANS_TABLE_BITS = 12;
+inline constexpr u32 TANS_TABLE_SIZE = 1<<TANS_TABLE_BITS;
+
+/* The maximum number of distinct tables kept by tans_tables */
+inline constexpr std::size_t TANS_TABLE_CACHE_SIZE = 16;
+
+
+/* Encoding and decoding tables for a normalized frequency table (totalling TANS_TABLE_SIZE) */
+struct TansTables{
+    /* Per-symbol encoding parameters (see the formulas above) */
+    struct SymbolTransform{
+        u32 delta_bits;
+        int32_t delta_state;
+    };
+
+    StaticModel::FrequencyTable frequencies;
+    std::array<SymbolTransform, StaticModel::EOF_SYMBOL+1> transforms;
+    std::array<u16, TANS_TABLE_SIZE> encode_table;   //Next encoder state (in [L, 2L))
+    std::array<u32, TANS_TABLE_SIZE> decode_table;   //Base of the next state (bits 0 - 15), number
+                                                     //of bits to read (bits 16 - 23) and symbol (bits 24 - 31)
+
+    explicit TansTables( const StaticModel::FrequencyTable& frequencies ): frequencies {frequencies} {
+        constexpr u32 L = TANS_TABLE_SIZE;
+        //Spread the symbols through the table (the step is odd, so every slot is visited once)
+        constexpr u32 STEP = (L>>1) + (L>>3) + 3;
+        std::array<u16, TANS_TABLE_SIZE> slot_symbols {};
+        u32 position {0};
+        for (u32 symbol {0}; symbol <= StaticModel::EOF_SYMBOL; symbol++){
+            for (u32 i {0}; i < frequencies.at(symbol); i++){
+                slot_symbols.at(position) = symbol;
+                position = (position + STEP) & (L - 1);
+            }
+        }
+
+        //The slots of each symbol (in table order) are numbered from its frequency f up to
+        //2f - 1. The encoder maps the number back to the slot, and the decoder maps the
+        //slot to the range of next states [number << num_bits, (number + 1) << num_bits).
+        std::array<u32, StaticModel::EOF_SYMBOL+1> next_number {};
+        std::array<u32, StaticModel::EOF_SYMBOL+1> cumulative {};
+        u32 total {0};
+        for (u32 symbol {0}; symbol <= StaticModel::EOF_SYMBOL; symbol++){
+            next_number.at(symbol) = frequencies.at(symbol);
+            cumulative.at(symbol) = total;
+            total += frequencies.at(symbol);
+        }
+        for (u32 slot {0}; slot < L; slot++){
+            u32 symbol = slot_symbols.at(slot);
+            u32 number = next_number.at(symbol)++;
+            u32 num_bits = TANS_TABLE_BITS - (std::bit_width(number) - 1);
+            encode_table.at(cumulative.at(symbol) + number - frequencies.at(symbol)) = L + slot;
+            decode_table.at(slot) = ((number<<num_bits) - L) | (num_bits<<16) | ((symbol & 0xff)<<24);
+        }
+
+        for (u32 symbol {0}; symbol <= StaticModel::EOF_SYMBOL; symbol++){
+            u32 frequency = frequencies.at(symbol);
+            SymbolTransform& transform = transforms.at(symbol);
+            //A state x in [L, 2L) sheds max_bits bits if x >= frequency << max_bits, and
+            //max_bits - 1 bits otherwise (leaving a number in [frequency, 2*frequency))
+            u32 max_bits = frequency <= 1 ? TANS_TABLE_BITS : TANS_TABLE_BITS - (std::bit_width(frequency - 1) - 1);
+            transform.delta_bits = (max_bits<<16) - (frequency<<max_bits);
+            transform.delta_state = (int32_t)cumulative.at(symbol) - (int32_t)frequency;
+        }
+    }
+};
+
+
+/* Return the tables for the provided normalized frequencies, reusing the tables built
+   for an earlier call with the same frequencies if they are still cached (this may be
+   called from multiple threads at once) */
+inline std::shared_ptr<const TansTables> tans_tables( const StaticModel::FrequencyTable& frequencies ){
+    static std::mutex cache_mutex {};
+    static std::vector<std::shared_ptr<const TansTables>> cache {};
+    {
+        std::lock_guard<std::mutex> lock {cache_mutex};
+        for (const auto& tables: cache)
+            if (tables->frequencies == frequencies)
+                return tables;
+    }
+    //Build the tables without holding the lock (another thread might build the same
+    //tables at the same time, in which case both copies are equally valid)
+    auto tables = std::make_shared<const TansTables>(frequencies);
+    std::lock_guard<std::mutex> lock {cache_mutex};
+    if (cache.size() == TANS_TABLE_CACHE_SIZE)
+        cache.erase(cache.begin());
+    cache.push_back(tables);
+    return tables;
+}
+
+
+
+template<StaticFrequencyModel Model, typename OutStream>
+class TansEncoder{
+public:
+    /* Constructor */
+    TansEncoder( Model& model, OutStream& stream ): tables {tans_tables(normalized_byte_frequencies(model, TANS_TABLE_BITS))}, stream {stream} {
+
+    }
+
+    /* Encode every byte of the provided buffer (the symbols are only buffered
+       until finish() is called) */
+    void encode(const u8* data, std::size_t length){
+        symbols.insert(symbols.end(), data, data + length);
+    }
+
+    /* Encode a single symbol (which is only buffered until finish() is called) */
+    void encode_symbol(u32 symbol){
+        symbols.push_back(symbol);
+    }
+
+    /* Encode all of the buffered symbols and write the result to the stream
+       (no further symbols may be encoded afterward) */
+    void finish(){
+        ARITH32_STAT_CYCLES(EncodeCycles);
+        ARITH32_STAT_ADD(SymbolsEncoded, symbols.size());
+        //The bits for each symbol, stored as value | (num_bits << 16)
+        std::vector<u32> chunks {};
+        chunks.reserve(symbols.size());
+        u32 x = TANS_TABLE_SIZE;
+        for (std::size_t i = symbols.size(); i > 0; i--){
+            const auto& transform = tables->transforms[symbols[i-1]];
+            u32 num_bits = (x + transform.delta_bits)>>16;
+            chunks.push_back((x & ((1U<<num_bits) - 1)) | (num_bits<<16));
+            ARITH32_STAT_ADD(RenormalizationShifts, num_bits);
+            x = tables->encode_table[(x>>num_bits) + transform.delta_state];
+        }
+
+        u64 num_symbols = symbols.size();
+        stream.push_u32((u32)num_symbols);
+        stream.push_u32((u32)(num_symbols>>32));
+        stream.push_bits(x - TANS_TABLE_SIZE, TANS_TABLE_BITS);
+        for (std::size_t i = chunks.size(); i > 0; i--)
+            stream.push_bits(chunks[i-1] & 0xffff, chunks[i-1]>>16);
+        symbols.clear();
+    }
+
+private:
+    std::shared_ptr<const TansTables> tables;
+    OutStream& stream;
+    std::vector<u8> symbols {};
+};
+
+
+
+template<StaticFrequencyModel Model, typename InStream>
+class TansDecoder{
+public:
+    /* Constructor (reads the symbol count and initial state from the stream) */
+    TansDecoder( Model& model, InStream& stream ): tables {tans_tables(normalized_byte_frequencies(model, TANS_TABLE_BITS))}, stream {stream}, num_symbols {0}, position {0}, state {0}, done {false} {
+        num_symbols = stream.read_u32();
+        num_symbols |= (u64)stream.read_u32()<<32;
+        state = stream.read_bits(TANS_TABLE_BITS);
+    }
+
+    /* Decode symbols into the provided buffer until either the buffer is full or
+       every symbol has been decoded. Returns the number of bytes written. */
+    std::size_t decode(u8* output, std::size_t capacity){
+        ARITH32_STAT_CYCLES(DecodeCycles);
+        std::size_t length = std::min<u64>(capacity, num_symbols - position);
+        const u32* decode_table = tables->decode_table.data();
+        for (std::size_t i {0}; i < length; i++){
+            u32 entry = decode_table[state];
+            output[i] = entry>>24;
+            state = (entry & 0xffff) + stream.read_bits((entry>>16) & 0xff);
+            ARITH32_STAT_ADD(RenormalizationShifts, (entry>>16) & 0xff);
+        }
+        ARITH32_STAT_ADD(SymbolsDecoded, length);
+        position += length;
+        if (position == num_symbols)
+            done = true;
+        return length;
+    }
+
+    /* Returns true once every symbol has been decoded */
+    bool finished() const{
+        return done;
+    }
+
+    /* Decode a single symbol (EOF_SYMBOL is returned once every symbol has been decoded) */
+    u32 decode_symbol(){
+        if (position == num_symbols){
+            done = true;
+            return Model::EOF_SYMBOL;
+        }
+        u8 symbol;
+        decode(&symbol, 1);
+        return symbol;
+    }
+
+private:
+    std::shared_ptr<const TansTables> tables;
+    InStream& stream;
+    u64 num_symbols;
+    u64 position;
+    u32 state;
+    bool done;
+};
+
+
+#endif
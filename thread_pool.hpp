@@ -0,0 +1,106 @@
+/* thread_pool.hpp
+
+   A minimal fixed-size thread pool (used to code independent blocks in parallel).
+*/
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <latch>
+#include <algorithm>
+#include <cstddef>
+
+
+class ThreadPool{
+public:
+    /* Constructor (run parallel_for on num_threads threads in all, or on one per
+       hardware thread if num_threads is 0). Since the thread which calls parallel_for
+       also runs tasks, this starts num_threads - 1 worker threads. */
+    explicit ThreadPool( unsigned int num_threads = 0 ): stopping {false} {
+        if (num_threads == 0)
+            num_threads = std::max(1U, std::thread::hardware_concurrency());
+        for (unsigned int i = 1; i < num_threads; i++)
+            workers.emplace_back([this]{ worker_loop(); });
+    }
+
+    /* Destructor (finish any queued tasks, then stop the worker threads) */
+    ~ThreadPool(){
+        {
+            std::lock_guard<std::mutex> lock {queue_mutex};
+            stopping = true;
+        }
+        queue_changed.notify_all();
+        for (auto& worker: workers)
+            worker.join();
+    }
+
+    ThreadPool( const ThreadPool& ) = delete;
+    ThreadPool& operator=( const ThreadPool& ) = delete;
+
+    /* Number of threads which run parallel_for's tasks (the worker threads and the calling thread) */
+    unsigned int size() const{
+        return workers.size() + 1;
+    }
+
+    /* Queue a task to run on one of the worker threads */
+    void submit(std::function<void()> task){
+        {
+            std::lock_guard<std::mutex> lock {queue_mutex};
+            tasks.push_back(std::move(task));
+        }
+        queue_changed.notify_one();
+    }
+
+    /* Call task(i) for every i in [0, count), spread over the worker threads
+       (and the calling thread), and return once every call has finished.
+       Indices are handed out one at a time, so tasks of uneven length balance out. */
+    void parallel_for(std::size_t count, const std::function<void(std::size_t)>& task){
+        std::atomic<std::size_t> next_index {0};
+        auto run_tasks = [&]{
+            for (std::size_t i; (i = next_index++) < count; )
+                task(i);
+        };
+        std::size_t helpers = std::min<std::size_t>(workers.size(), count > 0? count - 1 : 0);
+        std::latch helpers_done {(std::ptrdiff_t)helpers};
+        for (std::size_t i = 0; i < helpers; i++){
+            submit([&]{
+                run_tasks();
+                helpers_done.count_down();
+            });
+        }
+        run_tasks();
+        helpers_done.wait();
+    }
+
+private:
+    void worker_loop(){
+        while(1){
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock {queue_mutex};
+                queue_changed.wait(lock, [this]{ return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return; //Only reached once stopping is set
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex queue_mutex;
+    std::condition_variable queue_changed;
+    bool stopping;
+};
+
+
+#endif
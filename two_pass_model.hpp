@@ -0,0 +1,129 @@
+/* two_pass_model.hpp
+
+   Two-pass static model: the encoder builds a byte histogram of the entire
+   input, normalizes it to a total of 2^TOTAL_BITS and stores the normalized
+   frequencies in a compact header at the start of the stream, from which the
+   decoder rebuilds the same model (including CF_low and the lookup table).
+   After the header is read, coding proceeds exactly as with any other static
+   model, so there is no adaptive update cost in the coding loop.
+
+   Header format (all byte aligned):
+     32 bytes     Bitmap of which byte values (0 - 255) occur in the input
+                  (LSB first, so bit i of byte j is set if value 8j+i occurs).
+     varints      For each byte value that occurs (in increasing order), and then
+                  for the EOF symbol (unless it has been removed with remove_eof_symbol,
+                  in which case the decoder's model must also have had it removed),
+                  the normalized frequency minus 1 as a LEB128
+                  varint (7 bits per byte, least significant group first, with the
+                  high bit of each byte set if more bytes follow).
+*/
+
+#ifndef TWO_PASS_MODEL_HPP
+#define TWO_PASS_MODEL_HPP
+
+#include <array>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "static_model.hpp"
+#include "histogram.hpp"
+
+
+class TwoPassModel: public PowerOfTwoStaticModel<>{
+public:
+    /* Constructor (the frequencies must be set by read_header before decoding) */
+    TwoPassModel(){
+
+    }
+
+    /* Constructor (build the model from the histogram of the data to be encoded) */
+    TwoPassModel( const u8* data, std::size_t length ){
+        build(data, length);
+    }
+
+    /* Rebuild the model from the histogram of the data to be encoded */
+    void build( const u8* data, std::size_t length ){
+        set_histogram(byte_histogram(data, length));
+    }
+
+    /* Replace the frequencies with the normalized version of the provided histogram */
+    void set_histogram( const ByteHistogram& histogram ){
+        std::array<u64, EOF_SYMBOL+1> counts {};
+        u64 total {0};
+        for (u32 symbol {0}; symbol < 256; symbol++){
+            counts.at(symbol) = histogram.at(symbol);
+            total += histogram.at(symbol);
+        }
+        counts.at(EOF_SYMBOL) = !eof_removed;
+        //Without the EOF symbol, an empty input would leave nothing to normalize
+        if (eof_removed && total == 0)
+            counts.at(0) = 1;
+        set_frequencies(normalize_frequencies(counts, TOTAL_BITS));
+    }
+
+    /* Remove the EOF symbol (which must be done before build or read_header) */
+    void remove_eof_symbol(){
+        eof_removed = true;
+        PowerOfTwoStaticModel::remove_eof_symbol();
+    }
+
+    /* Write the normalized frequencies to the stream (see the format above) */
+    template<typename OutStream>
+    void write_header(OutStream& stream) const{
+        u64 low, high;
+        for (u32 i {0}; i < 32; i++){
+            u8 bitmap_byte {0};
+            for (u32 j {0}; j < 8; j++){
+                get_range(8*i + j, low, high);
+                bitmap_byte |= (high > low)<<j;
+            }
+            stream.push_byte(bitmap_byte);
+        }
+        for (u32 symbol {0}; symbol <= EOF_SYMBOL; symbol++){
+            get_range(symbol, low, high);
+            if (high == low)
+                continue;
+            u64 value = high - low - 1;
+            while(value >= 0x80){
+                stream.push_byte(0x80 | (value & 0x7f));
+                value >>= 7;
+            }
+            stream.push_byte(value);
+        }
+    }
+
+    /* Read the normalized frequencies from the stream (see the format above)
+       and rebuild the model from them */
+    template<typename InStream>
+    void read_header(InStream& stream){
+        std::array<u8, 32> bitmap {};
+        for (auto& bitmap_byte: bitmap)
+            bitmap_byte = stream.read_byte();
+        FrequencyTable frequencies {};
+        for (u32 symbol {0}; symbol <= EOF_SYMBOL; symbol++){
+            if (symbol != EOF_SYMBOL && !((bitmap.at(symbol/8)>>(symbol%8))&1))
+                continue;
+            if (symbol == EOF_SYMBOL && eof_removed)
+                continue;
+            u64 value {0};
+            for (u32 shift {0}; shift < 35; shift += 7){
+                u8 b = stream.read_byte();
+                value |= (u64)(b & 0x7f)<<shift;
+                if (!(b & 0x80))
+                    break;
+            }
+            frequencies.at(symbol) = value + 1;
+        }
+        //A valid header always includes at least one symbol (but a corrupt one might not)
+        if (std::all_of(frequencies.begin(), frequencies.end(), [](u32 f){ return f == 0; }))
+            frequencies.at(0) = 1;
+        //A valid header already totals 2^TOTAL_BITS (so normalizing has no effect)
+        set_frequencies(frequencies);
+    }
+
+private:
+    bool eof_removed {false};
+};
+
+
+#endif